@@ -0,0 +1,180 @@
+#include <algorithm>
+#include <istream>
+#include <numeric>
+#include <ostream>
+#include <stdexcept>
+#include "Adaptive.h"
+#include "Analysis.h"
+#include "Endian.h"
+
+namespace Combinators {
+	static constexpr std::string_view profileMagic = "PCPROF01";
+	static constexpr const char* profileEnd = "profile: Unexpected end of the choice profile";
+
+	std::shared_ptr<ChoiceProfile::Counters> ChoiceProfile::counters(const std::string& name, std::size_t alternatives) {
+		std::lock_guard lock(mutex_);
+		auto& counters = choices_[name];
+		if (counters == nullptr || counters->hits.size() != alternatives) {
+			// a profile of another version of the grammar doesn't fit
+			counters = std::make_shared<Counters>(alternatives);
+		}
+		return counters;
+	}
+
+	std::map<std::string, std::vector<std::uint64_t>> ChoiceProfile::counts() const {
+		std::lock_guard lock(mutex_);
+		std::map<std::string, std::vector<std::uint64_t>> counts;
+		for (auto& [name, counters] : choices_) {
+			auto& hits = counts[name];
+			for (auto& hit : counters->hits) {
+				hits.push_back(hit.load(std::memory_order_relaxed));
+			}
+		}
+		return counts;
+	}
+
+	void ChoiceProfile::write(std::ostream& out) const {
+		const auto choices = counts();
+		out.write(profileMagic.data(), profileMagic.length());
+		writeInt<std::uint32_t>(out, static_cast<std::uint32_t>(choices.size()));
+		for (auto& [name, hits] : choices) {
+			writeInt<std::uint32_t>(out, static_cast<std::uint32_t>(name.length()));
+			out.write(name.data(), name.length());
+			writeInt<std::uint32_t>(out, static_cast<std::uint32_t>(hits.size()));
+			for (auto hit : hits) {
+				writeInt<std::uint64_t>(out, hit);
+			}
+		}
+	}
+
+	void ChoiceProfile::load(std::istream& in) {
+		std::string magic(profileMagic.length(), '\0');
+		if (!in.read(magic.data(), magic.length()) || magic != profileMagic) {
+			throw std::runtime_error("profile: Not a choice profile");
+		}
+		// the whole profile is read and checked before any count is added, the counts before the counters are made
+		std::vector<std::pair<std::string, std::vector<std::uint64_t>>> choices;
+		const auto choiceCount = readInt<std::uint32_t>(in, profileEnd);
+		for (std::uint32_t i = 0; i < choiceCount; ++i) {
+			auto name = readBytes(in, readInt<std::uint32_t>(in, profileEnd), profileEnd);
+			const auto alternatives = readInt<std::uint32_t>(in, profileEnd);
+			if (alternatives > bytesLeft(in) / sizeof(std::uint64_t)) {
+				throw std::runtime_error(profileEnd);
+			}
+			std::vector<std::uint64_t> hits;
+			for (std::uint32_t j = 0; j < alternatives; ++j) {
+				hits.push_back(readInt<std::uint64_t>(in, profileEnd));
+			}
+			choices.emplace_back(std::move(name), std::move(hits));
+		}
+		std::lock_guard lock(mutex_);
+		// a choice with another number of alternatives is of another grammar
+		std::map<std::string_view, std::size_t> sizes;
+		for (auto& [name, hits] : choices) {
+			const auto registered = choices_.find(name);
+			const auto size = registered != choices_.end() ? registered->second->hits.size() : sizes.try_emplace(name, hits.size()).first->second;
+			if (size != hits.size()) {
+				throw std::runtime_error(std::format("profile: Choice \"{}\" has {} alternatives, the profile {}", name, size, hits.size()));
+			}
+		}
+		for (auto& [name, hits] : choices) {
+			auto& counters = choices_[name];
+			if (counters == nullptr) {
+				counters = std::make_shared<Counters>(hits.size());
+			}
+			for (std::size_t i = 0; i < hits.size(); ++i) {
+				counters->hits[i].fetch_add(hits[i], std::memory_order_relaxed);
+			}
+		}
+	}
+
+	// order of the alternatives shared by the runs, replaced as a whole when the hits change it
+	struct AdaptiveOrder
+	{
+		std::once_flag analyzed;
+		// [begin, end) of neighbours which can trade places
+		std::vector<std::pair<std::size_t, std::size_t>> runs;
+		std::mutex reorderMutex;
+		std::atomic<std::shared_ptr<const std::vector<std::size_t>>> order;
+
+		void analyze(const Parser& parser) {
+			const auto analysis = GrammarAnalysis::analyze(parser);
+			const auto& alternatives = parser.node->children;
+			// an alternative joins the run when it can't match the input of any other alternative of the run
+			std::bitset<256> runBytes;
+			std::size_t begin = 0;
+			for (std::size_t i = 0; i < alternatives.size(); ++i) {
+				const auto& first = analysis.first(alternatives[i]);
+				const bool movable = analysis.nullable(alternatives[i]) == Nullable::No && !first.opaque;
+				if (!movable || (runBytes & first.bytes).any()) {
+					if (i - begin > 1) {
+						runs.emplace_back(begin, i);
+					}
+					begin = movable ? i : i + 1;
+					runBytes.reset();
+				}
+				if (movable) {
+					runBytes |= first.bytes;
+				}
+			}
+			if (alternatives.size() - begin > 1) {
+				runs.emplace_back(begin, alternatives.size());
+			}
+		}
+
+		void reorder(const ChoiceProfile::Counters& counters) {
+			std::vector<std::uint64_t> hits;
+			for (auto& hit : counters.hits) {
+				hits.push_back(hit.load(std::memory_order_relaxed));
+			}
+			std::vector<std::size_t> next(hits.size());
+			std::iota(next.begin(), next.end(), std::size_t{ 0 });
+			for (auto [begin, end] : runs) {
+				std::stable_sort(next.begin() + begin, next.begin() + end, [&hits](std::size_t a, std::size_t b) { return hits[a] > hits[b]; });
+			}
+			order.store(std::make_shared<const std::vector<std::size_t>>(std::move(next)), std::memory_order_release);
+		}
+	};
+
+	Parser Parsers::adaptiveChoice(const std::string& name, const std::vector<Parser>& parsers, ChoiceProfile& profile,
+		std::size_t reorderInterval) {
+		const auto adaptiveNode = node(GrammarNode::Kind::AdaptiveChoice, parsers, name);
+		auto counters = profile.counters(name, parsers.size());
+		auto adaptive = std::make_shared<AdaptiveOrder>();
+		reorderInterval = std::max<std::size_t>(reorderInterval, 1);
+		auto adaptiveChoice = [parsers, adaptiveNode, counters, adaptive, reorderInterval](const ParserState& state) {
+			if (state.isError) {
+				return state;
+			}
+			std::call_once(adaptive->analyzed, [&]() {
+				adaptive->analyze(Parser{ {}, adaptiveNode });
+				adaptive->reorder(*counters);
+			});
+			// one reorder at a time, the other runs keep the previous order
+			if (counters->calls.fetch_add(1, std::memory_order_relaxed) % reorderInterval == reorderInterval - 1
+				&& !adaptive->runs.empty()) {
+				std::unique_lock lock(adaptive->reorderMutex, std::try_to_lock);
+				if (lock.owns_lock()) {
+					adaptive->reorder(*counters);
+				}
+			}
+			const auto order = adaptive->order.load(std::memory_order_acquire);
+			for (auto i : *order) {
+				const auto output = beginAttempt(state.context);
+				const auto nextState = parsers[i].transformerFn(state);
+				endAttempt(state.context, output, !nextState.isError);
+				if (!nextState.isError) {
+					counters->hits[i].fetch_add(1, std::memory_order_relaxed);
+					return nextState;
+				}
+				if (isAborted(nextState)) {
+					return nextState;
+				}
+				countBacktrack(state);
+			}
+			return updateParserFailure(state,
+				"choice: Unable to match with any parser at index {}", state.index);
+		};
+		return Parser{ adaptiveChoice, adaptiveNode };
+	}
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <atomic>
+#include <iosfwd>
+#include <map>
+#include <mutex>
+#include "ParserCombinators.h"
+
+namespace Combinators {
+	// Hit counts of Parsers::adaptiveChoice alternatives, by choice name. Counted from any number of threads;
+	// written from production runs and loaded before the grammar is built, the choices start in the order
+	// of the loaded counts
+	class ChoiceProfile
+	{
+	public:
+		// matches of each alternative of one choice
+		struct Counters
+		{
+			explicit Counters(std::size_t alternatives) : hits(alternatives) {}
+
+			std::vector<std::atomic<std::uint64_t>> hits;
+			std::atomic<std::uint64_t> calls = 0;
+		};
+
+		// counters of the choice, the loaded ones when the number of alternatives is the same
+		std::shared_ptr<Counters> counters(const std::string& name, std::size_t alternatives);
+
+		// hits of each choice
+		std::map<std::string, std::vector<std::uint64_t>> counts() const;
+
+		// binary profile of the hit counts
+		void write(std::ostream& out) const;
+		// adds the counts of a written profile, throws std::runtime_error (adding nothing) for a stream which isn't one
+		// and for a choice registered with another number of alternatives
+		void load(std::istream& in);
+
+	private:
+		mutable std::mutex mutex_;
+		std::map<std::string, std::shared_ptr<Counters>, std::less<>> choices_;
+	};
+}
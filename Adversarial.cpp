@@ -0,0 +1,125 @@
+#include <random>
+#include <set>
+#include "Adversarial.h"
+
+namespace Combinators {
+	RunCost measureRun(const Parser& parser, const std::string_view& input, std::chrono::nanoseconds timeLimit) {
+		RunStats stats;
+		MemoTable memo;
+		RunContext context{ .memo = &memo, .stats = &stats };
+		context.startRun(input);
+		const auto start = std::chrono::steady_clock::now();
+		if (timeLimit != std::chrono::nanoseconds::max()) {
+			context.deadline = start + timeLimit;
+		}
+		// the counters of the search stay out of RunStats::total(), so without Parser::run
+		const auto state = parser.transformerFn(ParserState{ input, 0, {}, false, {}, &context });
+		const auto elapsed = std::chrono::steady_clock::now() - start;
+		return RunCost{ stats.invocations + stats.backtracks,
+			static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()),
+			!state.isError && state.index == input.length() };
+	}
+
+	// literals of the grammar, through the rules of lazy parsers
+	static void collectLiterals(const Parser& parser, std::set<const GrammarNode*>& visited, std::set<std::string>& literals) {
+		const auto* node = parser.node.get();
+		if (node == nullptr || !visited.insert(node).second) {
+			return;
+		}
+		if (node->kind == GrammarNode::Kind::Str && !node->text.empty()) {
+			literals.insert(node->text);
+		}
+		if (node->kind == GrammarNode::Kind::Lazy) {
+			collectLiterals(node->rule(), visited, literals);
+		}
+		for (auto& child : node->children) {
+			collectLiterals(child, visited, literals);
+		}
+	}
+
+	AdversarialInput findAdversarialInput(const Parser& parser, const AdversarialOptions& options) {
+		auto alphabet = options.alphabet;
+		if (alphabet.empty()) {
+			std::set<const GrammarNode*> visited;
+			std::set<std::string> literals{ "a", "0", " " };
+			collectLiterals(parser, visited, literals);
+			alphabet.assign(literals.begin(), literals.end());
+		}
+		std::mt19937_64 random(options.seed);
+		auto below = [&random](std::size_t limit) {
+			return limit == 0 ? 0 : static_cast<std::size_t>(random() % limit);
+		};
+		auto piece = [&]() -> const std::string& {
+			return alphabet[below(alphabet.size())];
+		};
+
+		auto evaluate = [&parser, &options](std::string input) {
+			const auto cost = measureRun(parser, input, options.runLimit);
+			const auto stepsPerByte = static_cast<double>(cost.steps) / std::max<std::size_t>(input.length(), 1);
+			return AdversarialInput{ std::move(input), cost, stepsPerByte };
+		};
+		auto best = evaluate(piece());
+		for (std::size_t i = 0; i < options.iterations; ++i) {
+			if (std::chrono::nanoseconds(best.cost.nanoseconds) > options.runLimit) {
+				break;
+			}
+			// a few pieces at a time, the cost of the next run can't jump too far
+			auto input = best.input;
+			const auto at = below(input.length() + 1);
+			switch (below(4)) {
+			case 0:
+				input.insert(at, piece());
+				break;
+			case 1:
+				if (at < input.length()) {
+					input.replace(at, 1, piece());
+				}
+				break;
+			case 2:
+				input.erase(at, 1 + below(4));
+				break;
+			default: {
+				// repetitions make most of the worst cases
+				const auto length = std::min<std::size_t>(1 + below(4), input.length() - std::min(at, input.length()));
+				input.insert(at, input.substr(at, length));
+				break;
+			}
+			}
+			if (input.length() > options.maxLength || input == best.input) {
+				continue;
+			}
+			auto candidate = evaluate(std::move(input));
+			// equal costs move on too, to get out of flat regions
+			if (candidate.stepsPerByte >= best.stepsPerByte) {
+				best = std::move(candidate);
+			}
+		}
+		return best;
+	}
+
+	std::vector<GrowthPoint> measureGrowth(const Parser& parser, const std::function<std::string(std::size_t size)>& makeInput,
+		std::size_t baseSize, std::span<const std::size_t> factors) {
+		std::vector<GrowthPoint> points;
+		for (auto factor : factors) {
+			const auto input = makeInput(baseSize * factor);
+			GrowthPoint point{ input.length(), measureRun(parser, input) };
+			for (int run = 0; run < 2; ++run) {
+				point.cost.nanoseconds = std::min(point.cost.nanoseconds, measureRun(parser, input).nanoseconds);
+			}
+			points.push_back(point);
+		}
+		return points;
+	}
+
+	bool growsLinearly(const std::vector<GrowthPoint>& points, double tolerance, bool byTime) {
+		auto perByte = [byTime](const GrowthPoint& point) {
+			const auto cost = byTime ? point.cost.nanoseconds : point.cost.steps;
+			return static_cast<double>(cost) / std::max<std::size_t>(point.bytes, 1);
+		};
+		if (points.empty()) {
+			return true;
+		}
+		const auto first = perByte(points.front());
+		return std::ranges::all_of(points, [&](const GrowthPoint& point) { return perByte(point) <= first * tolerance; });
+	}
+}
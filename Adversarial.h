@@ -0,0 +1,57 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include "ParserCombinators.h"
+
+namespace Combinators {
+	// steps of a run: RunStats invocations and backtracks, the cost measure of the search and the growth checks
+	struct RunCost
+	{
+		std::uint64_t steps = 0;
+		std::uint64_t nanoseconds = 0;
+		bool matched = false;
+	};
+
+	// runs the parser with stats and a memo table of its own (not added to RunStats::total()),
+	// a run taking longer than timeLimit stops there
+	RunCost measureRun(const Parser& parser, const std::string_view& input,
+		std::chrono::nanoseconds timeLimit = std::chrono::nanoseconds::max());
+
+	struct AdversarialOptions
+	{
+		// characters and strings the inputs are built from, the literals of the grammar (and "a0 ") when empty
+		std::vector<std::string> alphabet{};
+		std::size_t maxLength = 256;
+		std::size_t iterations = 2000;
+		// a run taking longer is stopped and ends the search with its input, the grammar is super-linear already
+		std::chrono::milliseconds runLimit{ 200 };
+		std::uint64_t seed = 1;
+	};
+
+	struct AdversarialInput
+	{
+		std::string input;
+		RunCost cost;
+		double stepsPerByte = 0;
+	};
+
+	// Mutation search (replace, insert, erase and repeat parts of the input) for the input with the most
+	// steps per byte. Regex backtracking inside Parsers::regexp isn't counted in steps, only in the time.
+	AdversarialInput findAdversarialInput(const Parser& parser, const AdversarialOptions& options = {});
+
+	struct GrowthPoint
+	{
+		std::size_t bytes = 0;
+		RunCost cost;
+	};
+
+	// costs of the parser on makeInput(baseSize * factor) for every factor, the fastest of three runs each
+	std::vector<GrowthPoint> measureGrowth(const Parser& parser, const std::function<std::string(std::size_t size)>& makeInput,
+		std::size_t baseSize, std::span<const std::size_t> factors = std::array<std::size_t, 7>{ 1, 2, 4, 8, 16, 32, 64 });
+
+	// cost per byte of every point at most tolerance times the one of the first point, by steps or by time
+	bool growsLinearly(const std::vector<GrowthPoint>& points, double tolerance, bool byTime = false);
+}
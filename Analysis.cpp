@@ -0,0 +1,457 @@
+#include <algorithm>
+#include <map>
+#include <set>
+#include "Analysis.h"
+
+namespace Combinators {
+	using Kind = GrammarNode::Kind;
+
+	// nullability of a node from the ones of its children, Unknown for regexp and lazy rules
+	template<typename ChildFn>
+	static Nullable nodeNullable(const GrammarNode& node, ChildFn&& child) {
+		switch (node.kind) {
+		case Kind::Str:
+		case Kind::Literals:
+			return node.text.empty() ? Nullable::Yes : Nullable::No;
+		case Kind::Sequence:
+		case Kind::Between: {
+			auto result = Nullable::Yes;
+			for (auto& parser : node.children) {
+				result = std::min(result, child(parser));
+			}
+			return result;
+		}
+		case Kind::Choice:
+		case Kind::AdaptiveChoice: {
+			auto result = Nullable::No;
+			for (auto& parser : node.children) {
+				result = std::max(result, child(parser));
+			}
+			return result;
+		}
+		case Kind::Star:
+		case Kind::SepByStar:
+		case Kind::Peek:
+		case Kind::NotFollowedBy:
+			return Nullable::Yes;
+		case Kind::SepByPlus:
+			return child(node.children[1]);
+		case Kind::Integer:
+		case Kind::Varint:
+			return Nullable::No;
+		case Kind::Take:
+			return node.count == 0 ? Nullable::Yes : Nullable::No;
+		case Kind::LengthPrefixed:
+			// a field of length 0 can follow an empty length
+			return child(node.children[0]) == Nullable::No ? Nullable::No : Nullable::Unknown;
+		case Kind::RepeatLiteral:
+		case Kind::RepeatBytes:
+			return node.atLeastOne ? Nullable::No : Nullable::Yes;
+		case Kind::Plus:
+		case Kind::Map:
+		case Kind::MapError:
+		case Kind::Memo:
+		case Kind::Traced:
+		case Kind::AstNode:
+		case Kind::Named:
+		case Kind::Recognize:
+			return child(node.children[0]);
+		default:
+			return Nullable::Unknown;
+		}
+	}
+
+	Nullable nullable(const Parser& parser) {
+		if (parser.node == nullptr) {
+			return Nullable::Unknown;
+		}
+		return nodeNullable(*parser.node, [](const Parser& child) { return nullable(child); });
+	}
+
+	static std::string byteName(unsigned char byte) {
+		return byte >= 0x20 && byte < 0x7f ? std::format("'{}'", static_cast<char>(byte)) : std::format("0x{:02x}", byte);
+	}
+
+	struct GrammarAnalysis::Analyzer
+	{
+		// like Program, rules making new rules on every call stay unknown after these
+		static constexpr std::size_t maxRules = 4096;
+
+		GrammarAnalysis& analysis;
+		// every node once, parents before children
+		std::vector<const GrammarNode*> order{};
+		// Lazy nodes of each resolved rule node, the first found is reported
+		std::map<const GrammarNode*, std::vector<const GrammarNode*>> lazies{};
+		// resolved rule nodes in the order found
+		std::vector<const GrammarNode*> rules{};
+
+		void collect(const Parser& root) {
+			std::vector<Parser> pending{ root };
+			while (!pending.empty()) {
+				const auto parser = std::move(pending.back());
+				pending.pop_back();
+				const auto* node = parser.node.get();
+				if (node == nullptr || analysis.nodes_.contains(node)) {
+					continue;
+				}
+				analysis.nodes_[node] = Info{};
+				order.push_back(node);
+				if (node->kind == Kind::Lazy && analysis.rules_.size() < maxRules) {
+					auto rule = node->rule();
+					if (rule.node != nullptr) {
+						auto& nodes = lazies[rule.node.get()];
+						if (nodes.empty()) {
+							rules.push_back(rule.node.get());
+						}
+						nodes.push_back(node);
+					}
+					analysis.rules_.emplace(node, rule);
+					pending.push_back(std::move(rule));
+				}
+				for (auto& child : node->children) {
+					pending.push_back(child);
+				}
+			}
+		}
+
+		Info info(const Parser& parser) const {
+			const auto found = parser.node != nullptr ? analysis.nodes_.find(parser.node.get()) : analysis.nodes_.end();
+			if (found == analysis.nodes_.end()) {
+				return Info{ Nullable::Unknown, FirstSet{ {}, true } };
+			}
+			return found->second;
+		}
+
+		FirstSet first(const GrammarNode& node) const {
+			FirstSet first;
+			auto add = [&first](const FirstSet& other) {
+				first.bytes |= other.bytes;
+				first.opaque = first.opaque || other.opaque;
+			};
+			switch (node.kind) {
+			case Kind::Str:
+			case Kind::Literals:
+			case Kind::RepeatLiteral:
+				if (!node.text.empty()) {
+					first.bytes.set(static_cast<unsigned char>(node.text[0]));
+				}
+				break;
+			case Kind::RepeatBytes:
+				for (auto byte : node.text) {
+					first.bytes.set(static_cast<unsigned char>(byte));
+				}
+				break;
+			case Kind::Regexp:
+				first.opaque = true;
+				break;
+			case Kind::Take:
+				if (node.count == 0) {
+					break;
+				}
+				[[fallthrough]];
+			case Kind::Integer:
+			case Kind::Varint:
+				first.bytes.set();
+				break;
+			case Kind::LengthPrefixed: {
+				// the body starts after the length, a body of anything after an empty one
+				const auto lengthInfo = info(node.children[0]);
+				add(lengthInfo.first);
+				first.opaque = first.opaque || lengthInfo.nullable != Nullable::No;
+				break;
+			}
+			case Kind::Sequence:
+			case Kind::Between:
+				for (auto& child : node.children) {
+					const auto childInfo = info(child);
+					add(childInfo.first);
+					if (childInfo.nullable == Nullable::No) {
+						break;
+					}
+				}
+				break;
+			case Kind::Choice:
+			case Kind::AdaptiveChoice:
+				for (auto& child : node.children) {
+					add(info(child).first);
+				}
+				break;
+			case Kind::SepByStar:
+			case Kind::SepByPlus:
+				add(info(node.children[1]).first);
+				break;
+			default:
+				// star, plus, map and the wrappers
+				add(info(node.children[0]).first);
+				break;
+			}
+			return first;
+		}
+
+		Info compute(const GrammarNode& node) const {
+			if (node.kind == Kind::Lazy) {
+				const auto rule = analysis.rules_.find(&node);
+				return rule != analysis.rules_.end() ? info(rule->second) : Info{ Nullable::Unknown, FirstSet{ {}, true } };
+			}
+			return Info{ nodeNullable(node, [this](const Parser& child) { return info(child).nullable; }), first(node) };
+		}
+
+		// rules start with no empty matches and no bytes, the values only grow until nothing changes
+		void solve() {
+			bool changed = true;
+			while (changed) {
+				changed = false;
+				for (auto* node : std::views::reverse(order)) {
+					const auto next = compute(*node);
+					auto& current = analysis.nodes_[node];
+					if (next.nullable != current.nullable || next.first.bytes != current.first.bytes || next.first.opaque != current.first.opaque) {
+						current = next;
+						changed = true;
+					}
+				}
+			}
+		}
+
+		// name of the Traced parser of the rule, or its number
+		std::string ruleName(const GrammarNode* rule) const {
+			for (const auto* node = rule; node != nullptr; node = node->children.empty() ? nullptr : node->children[0].node.get()) {
+				if (node->kind == Kind::Traced || node->kind == Kind::Named) {
+					return node->text;
+				}
+				if (node->kind != Kind::Memo && node->kind != Kind::AstNode) {
+					break;
+				}
+			}
+			return std::format("#{}", std::ranges::find(rules, rule) - rules.begin());
+		}
+
+		// Lazy nodes the parser can call at its start index; through the rules they call for
+		// left recursion, memo rules stop the search for memo candidates
+		void leadingRules(const Parser& parser, bool throughRules, std::set<const GrammarNode*>& visited,
+			std::set<const GrammarNode*>& rules) const {
+			const auto* node = parser.node.get();
+			if (node == nullptr || !visited.insert(node).second) {
+				return;
+			}
+			switch (node->kind) {
+			case Kind::Lazy:
+				rules.insert(node);
+				if (const auto rule = analysis.rules_.find(node); throughRules && rule != analysis.rules_.end()) {
+					leadingRules(rule->second, throughRules, visited, rules);
+				}
+				break;
+			case Kind::Memo:
+				if (throughRules) {
+					leadingRules(node->children[0], throughRules, visited, rules);
+				}
+				break;
+			case Kind::Sequence:
+			case Kind::Between:
+			case Kind::SepByStar:
+			case Kind::SepByPlus:
+			case Kind::LengthPrefixed: {
+				// the value of sepBy comes before the separator
+				auto children = node->children;
+				if (node->kind == Kind::SepByStar || node->kind == Kind::SepByPlus) {
+					std::ranges::reverse(children);
+				}
+				for (auto& child : children) {
+					leadingRules(child, throughRules, visited, rules);
+					if (info(child).nullable == Nullable::No) {
+						break;
+					}
+				}
+				break;
+			}
+			case Kind::Choice:
+			case Kind::AdaptiveChoice:
+				for (auto& child : node->children) {
+					leadingRules(child, throughRules, visited, rules);
+				}
+				break;
+			case Kind::Star:
+			case Kind::Plus:
+			case Kind::Map:
+			case Kind::MapError:
+			case Kind::Traced:
+			case Kind::AstNode:
+			case Kind::Named:
+			case Kind::Peek:
+			case Kind::NotFollowedBy:
+			case Kind::Recognize:
+				leadingRules(node->children[0], throughRules, visited, rules);
+				break;
+			default:
+				break;
+			}
+		}
+
+		std::set<const GrammarNode*> leadingRules(const Parser& parser) const {
+			std::set<const GrammarNode*> visited;
+			std::set<const GrammarNode*> rules;
+			leadingRules(parser, false, visited, rules);
+			std::set<const GrammarNode*> resolved;
+			for (auto* lazy : rules) {
+				// memo rules keep their results already
+				if (const auto rule = analysis.rules_.find(lazy);
+					rule != analysis.rules_.end() && rule->second.node != nullptr && rule->second.node->kind != Kind::Memo) {
+					resolved.insert(rule->second.node.get());
+				}
+			}
+			return resolved;
+		}
+
+		// the parts of a sequence alternative, a single part for the others
+		static std::vector<Parser> parts(const Parser& parser) {
+			auto part = parser;
+			while (part.node != nullptr && (part.node->kind == Kind::Map || part.node->kind == Kind::MapError)) {
+				part = part.node->children[0];
+			}
+			if (part.node != nullptr && part.node->kind == Kind::Sequence) {
+				return part.node->children;
+			}
+			return { part };
+		}
+
+		static bool sameParser(const Parser& left, const Parser& right) {
+			if (left.node == nullptr || right.node == nullptr) {
+				return false;
+			}
+			if (left.node == right.node) {
+				return true;
+			}
+			const auto literal = [](const Parser& parser) {
+				return parser.node->kind == Kind::Str || parser.node->kind == Kind::Literals;
+			};
+			return literal(left) && literal(right) && left.node->text == right.node->text;
+		}
+
+		void warnLoops() {
+			for (auto* node : order) {
+				const auto name = node->kind == Kind::Star ? "star" : node->kind == Kind::Plus ? "plus" : "sepBy";
+				bool endless = false;
+				if (node->kind == Kind::Star || node->kind == Kind::Plus) {
+					endless = info(node->children[0]).nullable == Nullable::Yes;
+				}
+				else if (node->kind == Kind::SepByStar || node->kind == Kind::SepByPlus) {
+					endless = info(node->children[0]).nullable == Nullable::Yes && info(node->children[1]).nullable == Nullable::Yes;
+				}
+				if (endless) {
+					analysis.warnings_.push_back(GrammarWarning{ GrammarWarning::Kind::NullableLoop, node,
+						std::format("{}: Parser can match without consuming input, the loop never ends", name) });
+				}
+			}
+		}
+
+		void warnLeftRecursion() {
+			for (auto* rule : rules) {
+				const auto& nodes = lazies.at(rule);
+				std::set<const GrammarNode*> visited;
+				std::set<const GrammarNode*> called;
+				leadingRules(analysis.rules_.at(nodes.front()), true, visited, called);
+				if (std::ranges::any_of(nodes, [&called](auto* lazy) { return called.contains(lazy); })) {
+					analysis.warnings_.push_back(GrammarWarning{ GrammarWarning::Kind::LeftRecursion, nodes.front(),
+						std::format("lazy: Rule {} can call itself without consuming input", ruleName(rule)) });
+				}
+			}
+		}
+
+		void warnChoices() {
+			std::vector<GrammarWarning> overlaps;
+			// choices in which each rule runs again at the same index
+			std::map<const GrammarNode*, std::set<const GrammarNode*>> repeated;
+			for (auto* node : order) {
+				if (node->kind != Kind::Choice && node->kind != Kind::AdaptiveChoice) {
+					continue;
+				}
+				const auto& alternatives = node->children;
+				for (std::size_t i = 0; i < alternatives.size(); ++i) {
+					for (std::size_t j = i + 1; j < alternatives.size(); ++j) {
+						const auto& earlier = alternatives[i];
+						const auto& later = alternatives[j];
+						const auto* earlierNode = earlier.node.get();
+						const auto* laterNode = later.node.get();
+						if (earlierNode != nullptr && laterNode != nullptr && !earlierNode->text.empty()
+							&& (earlierNode->kind == Kind::Str || earlierNode->kind == Kind::Literals)
+							&& (laterNode->kind == Kind::Str || laterNode->kind == Kind::Literals)
+							&& laterNode->text.starts_with(earlierNode->text)) {
+							analysis.warnings_.push_back(GrammarWarning{ GrammarWarning::Kind::Shadowed, node,
+								std::format("choice: Alternative {} \"{}\" never matches after alternative {} \"{}\"",
+									j + 1, laterNode->text, i + 1, earlierNode->text) });
+							continue;
+						}
+						const auto common = info(earlier).first.bytes & info(later).first.bytes;
+						if (common.none()) {
+							continue;
+						}
+						std::string bytes;
+						std::size_t listed = 0;
+						for (std::size_t byte = 0; byte < common.size(); ++byte) {
+							if (common[byte] && listed++ < 8) {
+								bytes += (bytes.empty() ? "" : ", ") + byteName(static_cast<unsigned char>(byte));
+							}
+						}
+						if (listed > 8) {
+							bytes += ", ...";
+						}
+						overlaps.push_back(GrammarWarning{ GrammarWarning::Kind::Overlap, node,
+							std::format("choice: Alternatives {} and {} can both start with {}", i + 1, j + 1, bytes) });
+
+						// the same parts at the start of both are parsed again, then the rules both start with
+						const auto earlierParts = parts(earlier);
+						const auto laterParts = parts(later);
+						for (std::size_t k = 0; k < std::min(earlierParts.size(), laterParts.size()); ++k) {
+							const auto earlierRules = leadingRules(earlierParts[k]);
+							const auto laterRules = leadingRules(laterParts[k]);
+							for (auto* rule : earlierRules) {
+								if (laterRules.contains(rule)) {
+									repeated[rule].insert(node);
+								}
+							}
+							if (!sameParser(earlierParts[k], laterParts[k])) {
+								break;
+							}
+						}
+					}
+				}
+			}
+			std::ranges::move(overlaps, std::back_inserter(analysis.warnings_));
+
+			std::vector<std::pair<const GrammarNode*, std::size_t>> candidates;
+			for (auto* rule : rules) {
+				if (const auto found = repeated.find(rule); found != repeated.end()) {
+					candidates.emplace_back(rule, found->second.size());
+				}
+			}
+			std::ranges::stable_sort(candidates, std::ranges::greater{}, [](auto& candidate) { return candidate.second; });
+			for (auto [rule, choices] : candidates) {
+				analysis.warnings_.push_back(GrammarWarning{ GrammarWarning::Kind::MemoCandidate, lazies.at(rule).front(),
+					std::format("lazy: Rule {} is parsed again at the same index after backtracking in {} choice{}, memo would keep its results",
+						ruleName(rule), choices, choices == 1 ? "" : "s") });
+			}
+		}
+	};
+
+	GrammarAnalysis GrammarAnalysis::analyze(const Parser& parser) {
+		GrammarAnalysis analysis;
+		analysis.root_ = parser;
+		Analyzer analyzer{ analysis };
+		analyzer.collect(parser);
+		analyzer.solve();
+		analyzer.warnLoops();
+		analyzer.warnLeftRecursion();
+		analyzer.warnChoices();
+		return analysis;
+	}
+
+	Nullable GrammarAnalysis::nullable(const Parser& parser) const {
+		const auto found = parser.node != nullptr ? nodes_.find(parser.node.get()) : nodes_.end();
+		return found != nodes_.end() ? found->second.nullable : Nullable::Unknown;
+	}
+
+	const FirstSet& GrammarAnalysis::first(const Parser& parser) const {
+		static const FirstSet unknown{ {}, true };
+		const auto found = parser.node != nullptr ? nodes_.find(parser.node.get()) : nodes_.end();
+		return found != nodes_.end() ? found->second.first : unknown;
+	}
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <bitset>
+#include <unordered_map>
+#include "ParserCombinators.h"
+
+namespace Combinators {
+	// can the parser succeed without consuming input
+	enum class Nullable {
+		No,
+		// opaque parsers (map without a node, chain, succeed, ...), regexp and lazy rules not looked into
+		Unknown,
+		Yes
+	};
+
+	// from the grammar nodes alone, lazy rules aren't called (they can be incomplete while the grammar is built)
+	Nullable nullable(const Parser& parser);
+
+	// bytes a match can start with
+	struct FirstSet
+	{
+		std::bitset<256> bytes{};
+		// an opaque parser or a regexp can start the match too, with any byte
+		bool opaque = false;
+	};
+
+	struct GrammarWarning
+	{
+		enum class Kind {
+			// star, plus or sepBy over a parser which can match without consuming input
+			NullableLoop,
+			// a lazy rule which can call itself at the same index
+			LeftRecursion,
+			// choice alternatives starting with the same bytes, the later ones run after the earlier fail
+			Overlap,
+			// a choice alternative which can't match, an earlier str alternative is its prefix
+			Shadowed,
+			// a rule starting overlapping alternatives, parsed again at the same index after a backtrack
+			MemoCandidate
+		};
+
+		Kind kind;
+		// the loop, choice or Lazy node
+		const GrammarNode* node = nullptr;
+		std::string message{};
+	};
+
+	// Nullability, FIRST sets and warnings of a whole grammar, through its lazy rules.
+	// Parsers::star, plus and sepBy_* reject loops which never end when they are built,
+	// the analysis finds the ones going through lazy rules too.
+	// Inputs are treated as bytes, grammars over Lexer tokens get no useful FIRST sets.
+	class GrammarAnalysis
+	{
+	public:
+		static GrammarAnalysis analyze(const Parser& parser);
+
+		// Unknown for parsers outside of the analyzed grammar
+		Nullable nullable(const Parser& parser) const;
+		const FirstSet& first(const Parser& parser) const;
+
+		// endless loops and recursion, shadowed and overlapping choice alternatives, then memo candidates
+		// by the number of choices they are parsed again in
+		const std::vector<GrammarWarning>& warnings() const {
+			return warnings_;
+		}
+
+	private:
+		struct Info
+		{
+			Nullable nullable = Nullable::No;
+			FirstSet first{};
+		};
+
+		struct Analyzer;
+
+		// keeps the nodes alive
+		Parser root_{};
+		std::unordered_map<const GrammarNode*, Info> nodes_;
+		// resolved rule of each Lazy node
+		std::unordered_map<const GrammarNode*, Parser> rules_;
+		std::vector<GrammarWarning> warnings_;
+	};
+}
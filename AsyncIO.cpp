@@ -0,0 +1,77 @@
+#include "AsyncIO.h"
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <system_error>
+#include <unistd.h>
+
+namespace Combinators {
+	void EventLoop::waitReadable(int fd, std::coroutine_handle<> handle) {
+		waiting_.push_back(Waiter{ fd, handle });
+	}
+
+	std::size_t EventLoop::poll(int timeoutMs) {
+		if (waiting_.empty()) {
+			return 0;
+		}
+		std::vector<pollfd> fds;
+		fds.reserve(waiting_.size());
+		for (auto& waiter : waiting_) {
+			fds.push_back(pollfd{ waiter.fd, POLLIN, 0 });
+		}
+		if (::poll(fds.data(), fds.size(), timeoutMs) <= 0) {
+			return 0;
+		}
+		// resumed coroutines can wait again, so take the ready ones out first
+		std::vector<std::coroutine_handle<>> ready;
+		std::vector<Waiter> waiting;
+		for (std::size_t i = 0; i < fds.size(); ++i) {
+			if (fds[i].revents != 0) {
+				ready.push_back(waiting_[i].handle);
+			}
+			else {
+				waiting.push_back(waiting_[i]);
+			}
+		}
+		waiting_ = std::move(waiting);
+		for (auto handle : ready) {
+			handle.resume();
+		}
+		return ready.size();
+	}
+
+	void EventLoop::run() {
+		while (!waiting_.empty()) {
+			poll(-1);
+		}
+	}
+
+	FdSource::FdSource(EventLoop& loop, int fd) : loop_(loop), fd_(fd) {
+		::fcntl(fd_, F_SETFL, ::fcntl(fd_, F_GETFL) | O_NONBLOCK);
+	}
+
+	Task<std::string_view> FdSource::read() {
+		std::string_view chunk;
+		while (!tryRead(chunk)) {
+			co_await readable();
+		}
+		co_return chunk;
+	}
+
+	bool FdSource::tryRead(std::string_view& chunk) {
+		auto size = ::read(fd_, buffer_.data(), buffer_.size());
+		while (size < 0 && errno == EINTR) {
+			size = ::read(fd_, buffer_.data(), buffer_.size());
+		}
+		if (size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			return false;
+		}
+		if (size < 0) {
+			throw std::system_error(errno, std::generic_category(), std::format("read: Unable to read descriptor {}", fd_));
+		}
+		chunk = std::string_view(buffer_.data(), static_cast<std::size_t>(size));
+		return true;
+	}
+}
+#endif
@@ -0,0 +1,71 @@
+#pragma once
+// single thread readiness loop and socket/pipe sources for Program::runAsync (POSIX)
+#ifndef _WIN32
+#include <array>
+#include <coroutine>
+#include <string_view>
+#include <vector>
+#include "ParserCombinators.h"
+
+namespace Combinators {
+	// resumes coroutines waiting for readable file descriptors, one poll() for all of them
+	class EventLoop
+	{
+	public:
+		void waitReadable(int fd, std::coroutine_handle<> handle);
+
+		// one poll(), resumes the ready coroutines, returns their number
+		std::size_t poll(int timeoutMs);
+		// until no coroutine waits
+		void run();
+
+		std::size_t waiting() const {
+			return waiting_.size();
+		}
+
+	private:
+		struct Waiter
+		{
+			int fd;
+			std::coroutine_handle<> handle;
+		};
+
+		std::vector<Waiter> waiting_;
+	};
+
+	// non-blocking reads from a pipe or socket, the reading coroutine waits while the buffer is empty
+	// (also after a wakeup without data). Read errors are thrown as std::system_error to the awaiting coroutine.
+	class FdSource
+	{
+	public:
+		FdSource(EventLoop& loop, int fd);
+
+		// next chunk, empty at the end of input
+		Task<std::string_view> read();
+
+	private:
+		auto readable() {
+			struct awaiter {
+				FdSource& source;
+
+				bool await_ready() {
+					return false;
+				}
+				void await_suspend(std::coroutine_handle<> handle) {
+					source.loop_.waitReadable(source.fd_, handle);
+				}
+				void await_resume() {
+				}
+			};
+			return awaiter{ *this };
+		}
+
+		// false when no data is available yet, empty chunk at the end of input
+		bool tryRead(std::string_view& chunk);
+
+		EventLoop& loop_;
+		int fd_;
+		std::array<char, 4096> buffer_{};
+	};
+}
+#endif
@@ -0,0 +1,229 @@
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <print>
+#include "Bytecode.h"
+#include "Grammars.h"
+#include "Incremental.h"
+#ifndef _WIN32
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+using namespace Combinators;
+using Grammars::Format;
+
+// throughput and peak memory of the reference grammars against the hand-written baselines,
+// or the edit latency of IncrementalParser, which exits with 1 when the median edit on up to 1 MB takes over 1 ms
+// usage: ParserCombinators_bench [json|csv|ini|arithmetic|all|incremental] [sizes, e.g. 1K 64M 1G]
+
+struct Measurement
+{
+	double megabytesPerSecond = 0;
+	// peak resident set of the process which generated the input and parsed it, 0 when unknown
+	double peakMegabytes = 0;
+	bool matched = false;
+};
+
+static constexpr std::string_view runners[] = { "combinators", "program", "baseline" };
+
+static std::size_t parseSize(std::string_view text) {
+	std::size_t size = 0;
+	std::size_t i = 0;
+	for (; i < text.length() && std::isdigit(static_cast<unsigned char>(text[i])); ++i) {
+		size = size * 10 + (text[i] - '0');
+	}
+	const auto unit = i < text.length() ? std::toupper(static_cast<unsigned char>(text[i])) : ' ';
+	return size << (unit == 'K' ? 10 : unit == 'M' ? 20 : unit == 'G' ? 30 : 0);
+}
+
+static std::string sizeName(std::size_t size) {
+	if (size >= 1 << 30) {
+		return std::format("{} GB", size >> 30);
+	}
+	if (size >= 1 << 20) {
+		return std::format("{} MB", size >> 20);
+	}
+	return std::format("{} KB", size >> 10);
+}
+
+static Measurement measure(Format format, std::size_t size, std::string_view runner) {
+	const auto input = Grammars::corpus(format, size);
+	const auto program = Program::compile(Grammars::grammar(format));
+	const auto parser = Grammars::grammar(format);
+	auto parse = [&]() {
+		if (runner == "combinators") {
+			return parser.run(input);
+		}
+		if (runner == "program") {
+			return program.run(input);
+		}
+		return Grammars::baseline(format, input);
+	};
+	// small inputs run repeatedly for at least 100 ms
+	Measurement measurement{ .matched = true };
+	std::size_t runs = 0;
+	const auto start = std::chrono::steady_clock::now();
+	auto elapsed = std::chrono::duration<double>::zero();
+	do {
+		const auto state = parse();
+		measurement.matched = measurement.matched && !state.isError && state.index == input.length();
+		++runs;
+		elapsed = std::chrono::steady_clock::now() - start;
+	} while (elapsed < std::chrono::milliseconds(100));
+	measurement.megabytesPerSecond = static_cast<double>(input.length()) * runs / elapsed.count() / (1 << 20);
+#ifndef _WIN32
+	rusage usage{};
+	getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+	measurement.peakMegabytes = usage.ru_maxrss / double(1 << 20);
+#else
+	measurement.peakMegabytes = usage.ru_maxrss / double(1 << 10);
+#endif
+#endif
+	return measurement;
+}
+
+// in a child process of its own, so the peak memory is of this measurement only
+static Measurement measureIsolated(Format format, std::size_t size, std::string_view runner) {
+#ifndef _WIN32
+	int fds[2];
+	if (pipe(fds) == 0) {
+		std::fflush(stdout);
+		if (const auto child = fork(); child == 0) {
+			close(fds[0]);
+			const auto measurement = measure(format, size, runner);
+			const auto written = write(fds[1], &measurement, sizeof(measurement));
+			_exit(written == sizeof(measurement) ? 0 : 1);
+		}
+		else if (child > 0) {
+			close(fds[1]);
+			Measurement measurement;
+			const bool received = read(fds[0], &measurement, sizeof(measurement)) == sizeof(measurement);
+			close(fds[0]);
+			int status = 0;
+			waitpid(child, &status, 0);
+			// killed (e.g. out of memory) counts as not matched
+			return received ? measurement : Measurement{};
+		}
+		close(fds[0]);
+		close(fds[1]);
+	}
+#endif
+	return measure(format, size, runner);
+}
+
+template<typename Fn>
+static double milliseconds(Fn&& fn) {
+	const auto start = std::chrono::steady_clock::now();
+	fn();
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// the median edit on a document of up to 1 MB has to reparse within this many milliseconds
+static constexpr double editBudget = 1.0;
+
+// one-digit edits in the middle of a document of nested arrays with a memo rule per value: the full parse,
+// the first edit, the median of the next ones and of MemoTable::edit alone;
+// false when a run fails or the median edit goes over editBudget
+static bool measureIncremental(const std::vector<std::size_t>& sizes) {
+	bool passed = true;
+	Parser array_parser;
+	const auto number_parser = Parsers::digits();
+	const auto value_parser = Parsers::memo(Parsers::lazy([&array_parser, number_parser]() {
+		return Parsers::choice(number_parser, array_parser);
+	}));
+	array_parser = Parsers::between(Parsers::str("["), Parsers::str("]"))(Parsers::sepBy_star(Parsers::str(","))(value_parser));
+
+	std::println("| input | full parse ms | first edit ms | edit ms | memo table edit ms |");
+	std::println("|---|---:|---:|---:|---:|");
+	for (auto size : sizes) {
+		std::string document = "[";
+		while (document.length() < size) {
+			document += document.length() == 1 ? "[[1,2,3,4,5,6,7,8],[9,10,11,12]]" : ",[[1,2,3,4,5,6,7,8],[9,10,11,12]]";
+		}
+		document += "]";
+		IncrementalParser parser(array_parser, document);
+		MemoTable memo;
+		RunContext context{ .memo = &memo };
+		bool matched = true;
+		const auto full = milliseconds([&]() { matched = !array_parser.run(document, context).isError; });
+		parser.parse();
+		auto digit = [&parser](std::size_t offset) { return parser.text().find_first_of("123456789", offset); };
+		const auto first = milliseconds([&]() { matched = !parser.edit(digit(document.length() / 2), 1, "7").isError && matched; });
+		std::vector<double> edits;
+		std::vector<double> memoEdits;
+		for (std::size_t i = 1; i <= 21; ++i) {
+			const auto offset = digit(document.length() / 2 + i * 16);
+			edits.push_back(milliseconds([&]() { matched = !parser.edit(offset, 1, "3").isError && matched; }));
+			memoEdits.push_back(milliseconds([&]() { memo.edit(offset, 1, 1); }));
+		}
+		std::ranges::nth_element(edits, edits.begin() + edits.size() / 2);
+		std::ranges::nth_element(memoEdits, memoEdits.begin() + memoEdits.size() / 2);
+		if (!matched) {
+			std::println("| {} | failed | | | |", sizeName(size));
+			passed = false;
+			continue;
+		}
+		const auto edit = edits[edits.size() / 2];
+		std::println("| {} | {:.2f} | {:.2f} | {:.2f} | {:.3f} |", sizeName(size), full, first, edit, memoEdits[memoEdits.size() / 2]);
+		if (size <= (1 << 20) && edit > editBudget) {
+			std::println(std::cerr, "{}: the median edit took {:.2f} ms, over the {} ms budget", sizeName(size), edit, editBudget);
+			passed = false;
+		}
+	}
+	return passed;
+}
+
+int main(int argc, char* argv[])
+{
+	std::vector<Format> formats{ Format::Json, Format::Csv, Format::Ini, Format::Arithmetic };
+	std::vector<std::size_t> sizes;
+	bool incremental = false;
+	for (int i = 1; i < argc; ++i) {
+		const std::string_view arg = argv[i];
+		if (arg == "incremental") {
+			incremental = true;
+		}
+		else if (const auto format = Grammars::parseFormatName(arg)) {
+			formats = { *format };
+		}
+		else if (arg != "all" && parseSize(arg) != 0) {
+			sizes.push_back(parseSize(arg));
+		}
+		else if (arg != "all") {
+			std::println(std::cerr, "usage: {} [json|csv|ini|arithmetic|all|incremental] [sizes, e.g. 1K 64M 1G]", argv[0]);
+			return 2;
+		}
+	}
+	if (incremental) {
+		return measureIncremental(sizes.empty() ? std::vector<std::size_t>{ 64 << 10, 1 << 20 } : sizes) ? 0 : 1;
+	}
+	if (sizes.empty()) {
+		sizes = { 1 << 10, 1 << 20, 16 << 20 };
+	}
+
+	// markdown table, the ratio is the baseline throughput over the runner's
+	std::println("| grammar | input | parser | MB/s | peak RSS MB | slower than baseline |");
+	std::println("|---|---|---|---:|---:|---:|");
+	for (auto format : formats) {
+		for (auto size : sizes) {
+			std::vector<Measurement> measurements;
+			for (auto runner : runners) {
+				measurements.push_back(measureIsolated(format, size, runner));
+			}
+			for (std::size_t i = 0; i < std::size(runners); ++i) {
+				const auto& measurement = measurements[i];
+				if (!measurement.matched) {
+					std::println("| {} | {} | {} | failed | | |", Grammars::formatName(format), sizeName(size), runners[i]);
+					continue;
+				}
+				std::println("| {} | {} | {} | {:.1f} | {:.1f} | {:.1f}x |", Grammars::formatName(format), sizeName(size), runners[i],
+					measurement.megabytesPerSecond, measurement.peakMegabytes,
+					measurements.back().megabytesPerSecond / measurement.megabytesPerSecond);
+			}
+		}
+	}
+	return 0;
+}
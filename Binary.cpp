@@ -0,0 +1,210 @@
+#include <bit>
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+#include "ParserCombinators.h"
+
+namespace Combinators {
+	static void markExamined(const ParserState& state, std::size_t end) {
+		if (state.context != nullptr) {
+			state.context->examined = std::max(state.context->examined, end);
+		}
+	}
+
+	static const ParserState endOfInput(const ParserState& state, const std::string& name, std::uint32_t itemId) {
+		if (state.context != nullptr) {
+			state.context->failure.add(state.index, itemId);
+		}
+		return updateParserFailure(state, "{}: Got unexpected end of input.", name);
+	}
+
+	// one unaligned load, memcpy is the safe way to do it
+	template<typename T>
+	static std::uint64_t load(const char* data, std::endian order) {
+		T value;
+		std::memcpy(&value, data, sizeof(T));
+		return order == std::endian::native ? value : std::byteswap(value);
+	}
+
+	static std::uint64_t loadInteger(const char* data, std::size_t bytes, std::endian order) {
+		switch (bytes) {
+		case 1:
+			return static_cast<unsigned char>(data[0]);
+		case 2:
+			return load<std::uint16_t>(data, order);
+		case 4:
+			return load<std::uint32_t>(data, order);
+		case 8:
+			return load<std::uint64_t>(data, order);
+		default: {
+			// odd widths byte by byte
+			std::uint64_t value = 0;
+			for (std::size_t i = 0; i < bytes; ++i) {
+				const auto byte = static_cast<unsigned char>(data[order == std::endian::big ? i : bytes - 1 - i]);
+				value = value << 8 | byte;
+			}
+			return value;
+		}
+		}
+	}
+
+	Parser Parsers::integer(std::size_t bytes, std::endian order, bool isSigned) {
+		if (bytes == 0 || bytes > 8) {
+			throw std::invalid_argument(std::format("integer: Width of {} bytes, 1 to 8 are supported", bytes));
+		}
+		const auto name = std::format("{}int{}{}", isSigned ? "" : "u", bytes * 8, order == std::endian::big ? "be" : "le");
+		auto integer = [bytes, order, isSigned, name, itemId = FurthestFailure::itemId(name)](const ParserState& state) {
+			if (state.isError) {
+				return state;
+			}
+			countInvocation(state);
+			const auto index = state.index;
+			markExamined(state, index + bytes);
+			if (state.targetString.length() - index < bytes) {
+				return endOfInput(state, name, itemId);
+			}
+			if (skipValues(state)) {
+				return updateParserMatch(state, index + bytes, {}, itemId);
+			}
+			const auto value = loadInteger(state.targetString.data() + index, bytes, order);
+			if (!isSigned) {
+				return updateParserMatch(state, index + bytes, std::format("{}", value), itemId);
+			}
+			// sign extension from the top bit of the width
+			const auto shift = 64 - bytes * 8;
+			return updateParserMatch(state, index + bytes, std::format("{}", static_cast<std::int64_t>(value << shift) >> shift), itemId);
+		};
+		return Parser{ integer, node(GrammarNode::Kind::Integer, {}, name) };
+	}
+
+	Parser Parsers::varint(bool zigzag) {
+		auto varint = [zigzag, itemId = FurthestFailure::itemId("varint")](const ParserState& state) {
+			if (state.isError) {
+				return state;
+			}
+			countInvocation(state);
+			const auto& targetString = state.targetString;
+			// 7 bits per byte, the high bit marks a following byte; 10 bytes hold 64 bits
+			std::uint64_t value = 0;
+			auto index = state.index;
+			for (std::size_t shift = 0; ; shift += 7) {
+				if (index == targetString.length()) {
+					markExamined(state, index + 1);
+					return endOfInput(state, "varint", itemId);
+				}
+				const auto byte = static_cast<unsigned char>(targetString[index++]);
+				if (shift == 63 && byte > 1) {
+					break;
+				}
+				value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+				if ((byte & 0x80) == 0) {
+					markExamined(state, index);
+					if (skipValues(state)) {
+						return updateParserMatch(state, index, {}, itemId);
+					}
+					const auto text = zigzag
+						? std::format("{}", static_cast<std::int64_t>(value >> 1) ^ -static_cast<std::int64_t>(value & 1))
+						: std::format("{}", value);
+					return updateParserMatch(state, index, text, itemId);
+				}
+			}
+			markExamined(state, index);
+			if (state.context != nullptr) {
+				state.context->failure.add(state.index, itemId);
+			}
+			return updateParserFailure(state, "varint: Invalid varint at index {}", state.index);
+		};
+		return Parser{ varint, node(GrammarNode::Kind::Varint, {}, "varint") };
+	}
+
+	Parser Parsers::take(std::size_t count) {
+		const auto name = std::format("take {}", count);
+		auto take = [count, name, itemId = FurthestFailure::itemId(name)](const ParserState& state) {
+			if (state.isError) {
+				return state;
+			}
+			countInvocation(state);
+			const auto index = state.index;
+			markExamined(state, index + std::max<std::size_t>(count, 1));
+			if (state.targetString.length() - index < count) {
+				return endOfInput(state, name, itemId);
+			}
+			// the token event has the span, the value is the one copy
+			if (skipValues(state)) {
+				return updateParserMatch(state, index + count, {}, itemId);
+			}
+			return updateParserMatch(state, index + count, std::string(state.targetString.substr(index, count)), itemId);
+		};
+		return Parser{ take, std::make_shared<const GrammarNode>(GrammarNode{ GrammarNode::Kind::Take, name, {}, {}, {}, false, {},
+			std::numeric_limits<std::size_t>::max(), count }) };
+	}
+
+	Parser Parsers::lengthPrefixed(const Parser& lengthParser, const Parser& bodyParser) {
+		auto lengthPrefixed = [lengthParser, bodyParser, lengthId = FurthestFailure::itemId("length")](const ParserState& state) {
+			if (state.isError) {
+				return state;
+			}
+			// the length value is needed in sink and recognition mode too, the length is reported as one token
+			auto* context = state.context;
+			auto* sink = context != nullptr ? std::exchange(context->sink, nullptr) : nullptr;
+			const bool recognizing = context != nullptr && std::exchange(context->recognizing, false);
+			const auto lengthState = lengthParser.transformerFn(state);
+			if (context != nullptr) {
+				context->sink = sink;
+				context->recognizing = recognizing;
+			}
+			if (lengthState.isError) {
+				return lengthState;
+			}
+			std::uint64_t length = 0;
+			const auto lengthResult = lengthState.result.parts.empty() ? ParseResult{} : lengthState.result.flattened();
+			const auto& values = lengthState.result.parts.empty() ? lengthState.result.values : lengthResult.values;
+			if (values.empty() || std::from_chars(values.back().data(), values.back().data() + values.back().length(), length).ec != std::errc{}) {
+				return updateParserError(state, "lengthPrefixed: Length isn't a number at index {}", lengthState.index);
+			}
+			const auto start = lengthState.index;
+			if (length > state.targetString.length() - start) {
+				markExamined(state, start + length);
+				return updateParserError(lengthState,
+					"lengthPrefixed: Length {} past the end of the input at index {}", length, start);
+			}
+			if (sink != nullptr) {
+				sink->event(SinkEvent{ SinkEvent::Kind::Token, lengthId, state.index, start });
+			}
+			// the body sees the input up to the end of the field, indices stay the ones of the whole input.
+			// A memo entry of the shorter input would be found by the runs of the whole one
+			const auto end = static_cast<std::size_t>(start + length);
+			auto* memo = context != nullptr ? std::exchange(context->memo, nullptr) : nullptr;
+			auto bodyState = bodyParser.transformerFn(ParserState{ state.targetString.substr(0, end), start, {}, false, {}, context });
+			if (context != nullptr) {
+				context->memo = memo;
+			}
+			bodyState.targetString = state.targetString;
+			if (bodyState.isError) {
+				return bodyState;
+			}
+			if (bodyState.index != end) {
+				return updateParserError(bodyState,
+					"lengthPrefixed: Body ended at index {} before the end of the field at index {}", bodyState.index, end);
+			}
+			return bodyState;
+		};
+		return Parser{ lengthPrefixed, node(GrammarNode::Kind::LengthPrefixed, { lengthParser, bodyParser }, "lengthPrefixed") };
+	}
+
+	Parser Parsers::lengthPrefixed(const Parser& lengthParser) {
+		// all the bytes of the field
+		auto field = [itemId = FurthestFailure::itemId("field")](const ParserState& state) {
+			if (state.isError) {
+				return state;
+			}
+			countInvocation(state);
+			const auto end = state.targetString.length();
+			if (skipValues(state)) {
+				return updateParserMatch(state, end, {}, itemId);
+			}
+			return updateParserMatch(state, end, std::string(state.targetString.substr(state.index)), itemId);
+		};
+		return lengthPrefixed(lengthParser, Parser{ field });
+	}
+}
@@ -0,0 +1,397 @@
+#include "Bytecode.h"
+#include "Analysis.h"
+
+namespace Combinators {
+	struct Program::Compiler
+	{
+		// distinct lazy rules compiled to subroutines, the rest run as escapes
+		static constexpr std::size_t maxRules = 4096;
+
+		Program& program;
+		// loops over parsers which can match without consuming input run as escapes, the closures end them
+		const GrammarAnalysis analysis;
+		std::map<const GrammarNode*, std::uint32_t> rules{};
+		std::vector<Parser> pendingRules{};
+		std::vector<std::pair<std::size_t, const GrammarNode*>> calls{};
+
+		std::uint32_t here() const {
+			return static_cast<std::uint32_t>(program.code_.size());
+		}
+
+		std::size_t add(Opcode op, std::uint32_t arg = 0) {
+			program.code_.push_back(Instruction{ op, arg });
+			return program.code_.size() - 1;
+		}
+
+		void escape(const Parser& parser) {
+			add(Opcode::Escape, static_cast<std::uint32_t>(program.escapes_.size()));
+			program.escapes_.push_back(parser);
+		}
+
+		void star(const Parser& parser) {
+			const auto loop = here();
+			const auto choice = add(Opcode::Choice);
+			emit(parser);
+			add(Opcode::Commit, loop);
+			program.code_[choice].arg = here();
+		}
+
+		void sepBy(const Parser& separatorParser, const Parser& valueParser) {
+			const auto loop = here();
+			const auto valueChoice = add(Opcode::Choice);
+			emit(valueParser);
+			add(Opcode::Commit, here() + 1);
+			const auto separatorChoice = add(Opcode::Choice);
+			add(Opcode::Mark);
+			emit(separatorParser);
+			add(Opcode::Drop);
+			add(Opcode::Commit, loop);
+			program.code_[valueChoice].arg = here();
+			program.code_[separatorChoice].arg = here();
+		}
+
+		bool consumes(const Parser& parser) const {
+			return analysis.nullable(parser) == Nullable::No;
+		}
+
+		void emit(const Parser& parser) {
+			using Kind = GrammarNode::Kind;
+			const auto* node = parser.node.get();
+			if (node == nullptr) {
+				escape(parser);
+				return;
+			}
+			const bool loop = node->kind == Kind::Star || node->kind == Kind::Plus
+				|| node->kind == Kind::SepByStar || node->kind == Kind::SepByPlus;
+			if (loop && !std::ranges::any_of(node->children, [this](const Parser& child) { return consumes(child); })) {
+				escape(parser);
+				return;
+			}
+			switch (node->kind) {
+			case Kind::Str:
+				add(Opcode::Literal, static_cast<std::uint32_t>(program.literals_.size()));
+				program.literals_.push_back(node->text);
+				program.literalIds_.push_back(FurthestFailure::itemId(std::format("\"{}\"", node->text)));
+				break;
+			case Kind::Sequence:
+			case Kind::Literals:
+				for (auto& child : node->children) {
+					emit(child);
+				}
+				break;
+			case Kind::Choice: {
+				if (node->children.empty()) {
+					add(Opcode::Fail);
+					break;
+				}
+				std::vector<std::size_t> commits;
+				for (std::size_t i = 0; i + 1 < node->children.size(); ++i) {
+					const auto choice = add(Opcode::Choice);
+					emit(node->children[i]);
+					commits.push_back(add(Opcode::Commit));
+					program.code_[choice].arg = here();
+				}
+				emit(node->children.back());
+				for (auto commit : commits) {
+					program.code_[commit].arg = here();
+				}
+				break;
+			}
+			case Kind::Star:
+				star(node->children[0]);
+				break;
+			case Kind::Plus:
+				// the first match isn't optional, a match can give no values (astNode)
+				emit(node->children[0]);
+				star(node->children[0]);
+				break;
+			case Kind::Between: {
+				// the slicing map drops the bracket values only when each bracket gives one value
+				auto oneValue = [](const Parser& bracket) {
+					return bracket.node != nullptr && (bracket.node->kind == Kind::Str || bracket.node->kind == Kind::Regexp);
+				};
+				if (!oneValue(node->children[0]) || !oneValue(node->children[2])) {
+					escape(parser);
+					break;
+				}
+				add(Opcode::Mark);
+				emit(node->children[0]);
+				add(Opcode::Drop);
+				emit(node->children[1]);
+				add(Opcode::Mark);
+				emit(node->children[2]);
+				add(Opcode::Drop);
+				break;
+			}
+			case Kind::SepByStar:
+				sepBy(node->children[0], node->children[1]);
+				break;
+			case Kind::SepByPlus: {
+				// the first value isn't optional, then separator value pairs
+				emit(node->children[1]);
+				const auto loop = here();
+				const auto separatorChoice = add(Opcode::Choice);
+				add(Opcode::Mark);
+				emit(node->children[0]);
+				add(Opcode::Drop);
+				add(Opcode::Commit, here() + 1);
+				const auto valueChoice = add(Opcode::Choice);
+				emit(node->children[1]);
+				add(Opcode::Commit, loop);
+				program.code_[separatorChoice].arg = here();
+				program.code_[valueChoice].arg = here();
+				break;
+			}
+			case Kind::Map:
+				add(Opcode::Mark);
+				emit(node->children[0]);
+				add(Opcode::Map, static_cast<std::uint32_t>(program.maps_.size()));
+				program.maps_.push_back(node->map);
+				program.mapNames_.push_back(node->text);
+				break;
+			case Kind::MapError:
+				// only changes errors, which are reported by the closure parser
+				emit(node->children[0]);
+				break;
+			case Kind::Lazy:
+				if (!rules.contains(node)) {
+					if (rules.size() >= maxRules) {
+						escape(parser);
+						break;
+					}
+					rules[node] = 0;
+					pendingRules.push_back(parser);
+				}
+				calls.emplace_back(add(Opcode::Call), node);
+				break;
+			default:
+				// regexp and bulk scans don't gain anything from being split, memo, traced, astNode,
+				// adaptive choices and lookahead need their closures
+				escape(parser);
+				break;
+			}
+		}
+
+		void compile(const Parser& parser) {
+			emit(parser);
+			add(Opcode::End);
+			// rule bodies follow the main program, resolved once at compile time
+			std::vector<Parser> resolved;
+			while (!pendingRules.empty()) {
+				const auto rule = pendingRules.back();
+				pendingRules.pop_back();
+				rules[rule.node.get()] = here();
+				resolved.push_back(rule.node->rule());
+				emit(resolved.back());
+				add(Opcode::Return);
+			}
+			for (auto [call, node] : calls) {
+				program.code_[call].arg = rules[node];
+			}
+		}
+	};
+
+	Program Program::compile(const Parser& parser, std::size_t maxStackDepth) {
+		Program program;
+		program.maxStackDepth_ = maxStackDepth;
+		Compiler{ program, GrammarAnalysis::analyze(parser) }.compile(parser);
+		return program;
+	}
+
+	ParserState Program::run(const std::string_view& targetString) const {
+		RunContext context{};
+		return run(targetString, context);
+	}
+
+	ParserState Program::run(const std::string_view& targetString, RunContext& context) const {
+		context.startRun(targetString);
+		return countRunStats(context, [&]() {
+			if (context.utf8) {
+				if (const auto invalid = validateUtf8(targetString); invalid != targetString.length()) {
+					return ParserState{ targetString, invalid, {}, true, std::format("utf8: Invalid UTF-8 at index {}", invalid) };
+				}
+			}
+			Machine machine(*this);
+			machine.resume(targetString, true, context);
+			return machine.state();
+		});
+	}
+
+	ParseStatus Program::Machine::resume(const std::string_view& input, bool final, RunContext& context) {
+		if (status_ != ParseStatus::NeedMore) {
+			return status_;
+		}
+		const auto& program = *program_;
+		context.lines = LineIndex(input);
+
+		// back to the latest choice, false when there is none
+		auto backtrack = [this, &context]() {
+			while (!stack_.empty() && stack_.back().isCall) {
+				stack_.pop_back();
+			}
+			if (stack_.empty()) {
+				return false;
+			}
+			const auto& entry = stack_.back();
+			pc_ = entry.address;
+			index_ = entry.index;
+			values_.resize(entry.values);
+			marks_.resize(entry.marks);
+			endAttempt(&context, entry.output, false);
+			stack_.pop_back();
+			if (context.stats != nullptr) {
+				++context.stats->backtracks;
+			}
+			return true;
+		};
+		auto finish = [this, &context](ParseStatus status, ParserState&& state) {
+			// the attempts of the choices still open end with the run
+			for (auto entry = stack_.rbegin(); entry != stack_.rend(); ++entry) {
+				if (!entry->isCall) {
+					endAttempt(&context, entry->output, status == ParseStatus::Complete);
+				}
+			}
+			stack_.clear();
+			state.context = nullptr;
+			state_ = std::move(state);
+			status_ = status;
+			return status;
+		};
+
+		while (true) {
+			const auto [op, arg] = program.code_[pc_];
+			bool failed = false;
+			switch (op) {
+			case Opcode::Literal: {
+				const auto& literal = program.literals_[arg];
+				const auto rest = input.substr(index_);
+				context.examined = std::max(context.examined, index_ + std::max<std::size_t>(literal.length(), 1));
+				if (context.stats != nullptr) {
+					++context.stats->invocations;
+				}
+				if (!rest.empty() && rest.starts_with(literal)) {
+					if (context.sink != nullptr) {
+						context.sink->event(SinkEvent{ SinkEvent::Kind::Token, program.literalIds_[arg], index_, index_ + literal.length() });
+					}
+					else {
+						values_.push_back(literal);
+					}
+					index_ += literal.length();
+					++pc_;
+				}
+				else if (!final && rest.length() < std::max<std::size_t>(literal.length(), 1) && literal.starts_with(rest)) {
+					// the rest of the literal can still come
+					return ParseStatus::NeedMore;
+				}
+				else {
+					context.failure.add(index_, program.literalIds_[arg]);
+					failed = true;
+				}
+				break;
+			}
+			case Opcode::Escape: {
+				const ParserState state{ input, index_, {}, false, {}, &context };
+				const auto outerExamined = context.examined;
+				// the escape can run again with more input, its output waits until then
+				const auto output = final ? OutputMark{} : beginAttempt(&context);
+				context.examined = index_;
+				const auto nextState = program.escapes_[arg].transformerFn(state);
+				const auto examined = context.examined;
+				context.examined = std::max(outerExamined, examined);
+				const bool needMore = !final && examined > input.length();
+				if (!final) {
+					endAttempt(&context, output, !nextState.isError && !needMore);
+				}
+				if (isAborted(nextState)) {
+					return finish(ParseStatus::Error, ParserState{ input, nextState.index, {}, true, nextState.error });
+				}
+				if (needMore) {
+					// the result depends on input which didn't come yet, run it again then
+					return ParseStatus::NeedMore;
+				}
+				if (nextState.isError) {
+					// a failure with its items in context.failure leaves the message to them
+					if (!nextState.error.empty() && (escapeError_.empty() || nextState.index > escapeErrorIndex_)) {
+						escapeErrorIndex_ = nextState.index;
+						escapeError_ = nextState.error;
+					}
+					failed = true;
+					break;
+				}
+				values_.insert(values_.end(), nextState.result.values.begin(), nextState.result.values.end());
+				index_ = nextState.index;
+				++pc_;
+				break;
+			}
+			case Opcode::Choice:
+			case Opcode::Call:
+				if (countStep(&context)) {
+					auto state = abortAtLimit(ParserState{ input, index_, {}, false, {}, &context });
+					return finish(ParseStatus::Error, std::move(state));
+				}
+				if (stack_.size() >= program.maxStackDepth_) {
+					return finish(ParseStatus::Error, ParserState{ input, index_, {}, true,
+						std::format("vm: Stack limit {} reached at index {}", program.maxStackDepth_, index_) });
+				}
+				if (context.stats != nullptr) {
+					context.stats->maxDepth = std::max<std::uint64_t>(context.stats->maxDepth, stack_.size() + 1);
+				}
+				if (op == Opcode::Choice) {
+					stack_.push_back(Entry{ arg, false, index_, values_.size(), marks_.size(), beginAttempt(&context) });
+					++pc_;
+				}
+				else {
+					stack_.push_back(Entry{ pc_ + 1, true, index_, values_.size(), marks_.size() });
+					pc_ = arg;
+				}
+				break;
+			case Opcode::Commit:
+				endAttempt(&context, stack_.back().output, true);
+				stack_.pop_back();
+				pc_ = arg;
+				break;
+			case Opcode::Return:
+				pc_ = stack_.back().address;
+				stack_.pop_back();
+				break;
+			case Opcode::Mark:
+				marks_.push_back(values_.size());
+				++pc_;
+				break;
+			case Opcode::Drop:
+				values_.resize(marks_.back());
+				marks_.pop_back();
+				++pc_;
+				break;
+			case Opcode::Map: {
+				const auto mark = marks_.back();
+				marks_.pop_back();
+				if (context.sink == nullptr) {
+					ParseResult result{ { std::make_move_iterator(values_.begin() + mark), std::make_move_iterator(values_.end()) } };
+					values_.resize(mark);
+					result = program.maps_[arg](result);
+					values_.insert(values_.end(), result.values.begin(), result.values.end());
+				}
+				++pc_;
+				break;
+			}
+			case Opcode::Fail:
+				failed = true;
+				break;
+			case Opcode::End:
+				return finish(ParseStatus::Complete, ParserState{ input, index_, ParseResult{ std::move(values_) } });
+			}
+			if (failed && !backtrack()) {
+				// the furthest failure names what was expected, the error of an escape which got further
+				// (a closure without failure items) wins
+				if (context.failure.count != 0 && (escapeError_.empty() || context.failure.index >= escapeErrorIndex_)) {
+					return finish(ParseStatus::Error, ParserState{ input, context.failure.index, {}, true, context.failure.message() });
+				}
+				if (!escapeError_.empty()) {
+					return finish(ParseStatus::Error, ParserState{ input, escapeErrorIndex_, {}, true, std::move(escapeError_) });
+				}
+				return finish(ParseStatus::Error, ParserState{ input, index_, {}, true, std::format("vm: Unable to match at index {}", index_) });
+			}
+		}
+	}
+}
@@ -0,0 +1,162 @@
+#pragma once
+#include <cstdint>
+#include <iosfwd>
+#include <map>
+#include "ParserCombinators.h"
+
+namespace Combinators {
+	enum class Opcode : std::uint8_t {
+		// match literals[arg], push it as a value
+		Literal,
+		// run escapes[arg] closure parser (regexp, map, chain, contextual, ...), push its values
+		Escape,
+		// push a backtrack entry resuming at arg
+		Choice,
+		// pop the backtrack entry, jump to arg
+		Commit,
+		Call,
+		Return,
+		// remember the number of values
+		Mark,
+		// drop the values pushed since the mark
+		Drop,
+		// replace the values pushed since the mark by maps[arg] of them
+		Map,
+		Fail,
+		End
+	};
+
+	enum class ParseStatus {
+		// the input ended in the middle of the grammar
+		NeedMore,
+		Complete,
+		Error
+	};
+
+	struct Instruction
+	{
+		Opcode op;
+		std::uint32_t arg = 0;
+	};
+
+	// closures of a Program read back from a file, by the names given to Parsers::named and Parser::map
+	struct ProgramBindings
+	{
+		std::map<std::string, Parser, std::less<>> parsers{};
+		std::map<std::string, std::function<ParseResult(const ParseResult&)>, std::less<>> maps{};
+	};
+
+	// Grammar lowered to bytecode for a backtracking parsing machine (in the style of LPeg).
+	// str, sequenceOf, choice, star, plus, between, sepBy_*, map and lazy rules become instructions,
+	// other parsers run as escape instructions, so do loops over parsers which may match without consuming
+	// input (GrammarAnalysis can't tell otherwise). Nesting uses the heap stack of the machine,
+	// escapes still recurse natively (see RunContext::maxDepth).
+	// A failed run reports the furthest failure (RunContext::failure, "Expected X or Y at index N") without
+	// parsing the input again, or the error of an escape which failed further.
+	class Program
+	{
+	public:
+		static Program compile(const Parser& parser, std::size_t maxStackDepth = 1 << 20);
+
+		ParserState run(const std::string_view& targetString) const;
+		ParserState run(const std::string_view& targetString, RunContext& context) const;
+
+		// Binary image of the program, to build a large grammar once and read it back at startup.
+		// Escapes are written as the regexp pattern (Parsers::regexp from a string), bulk scans, or by the name
+		// of Parsers::named, maps by the name of Parser::map; throws std::invalid_argument for other closures.
+		void write(std::ostream& out) const;
+		// the image can be a memory mapped file; regexps are compiled on their first use.
+		// Throws std::runtime_error for bytes which aren't a program or a name without a binding
+		static Program read(std::string_view image, const ProgramBindings& bindings = {});
+		// read() of a memory mapped file (a plain read where mapping isn't available)
+		static Program readFile(const std::string& path, const ProgramBindings& bindings = {});
+
+		// parses input read by co_await source.read() -> std::string_view, empty at the end of input;
+		// the program must outlive the task
+		template<typename Source>
+		Task<ParserState> runAsync(Source& source) const {
+			Machine machine(*this);
+			RunContext context{};
+			std::string input;
+			while (true) {
+				const std::string_view chunk = co_await source.read();
+				input += chunk;
+				if (machine.resume(input, chunk.empty(), context) != ParseStatus::NeedMore) {
+					auto state = machine.state();
+					// the input dies with the coroutine
+					co_return ParserState{ {}, state.index, std::move(state.result), state.isError, std::move(state.error) };
+				}
+			}
+		}
+
+		// Run state of the program which can stop when the input ends and continue with more input.
+		// An instruction which looked at the end of the input runs again when the input grows,
+		// the rest of the run isn't repeated.
+		class Machine
+		{
+		public:
+			explicit Machine(const Program& program) : program_(&program) {}
+
+			// input - all the input so far, final - no more input will come
+			ParseStatus resume(const std::string_view& input, bool final, RunContext& context);
+
+			// result of a complete or failed run
+			const ParserState& state() const {
+				return state_;
+			}
+
+		private:
+			struct Entry
+			{
+				std::uint32_t address;
+				bool isCall;
+				std::size_t index;
+				std::size_t values;
+				std::size_t marks;
+				// output size of a choice (see beginAttempt)
+				OutputMark output{};
+			};
+
+			const Program* program_;
+			ParseStatus status_ = ParseStatus::NeedMore;
+			std::vector<Entry> stack_;
+			std::vector<std::string> values_;
+			std::vector<std::size_t> marks_;
+			std::size_t index_ = 0;
+			std::uint32_t pc_ = 0;
+			// furthest failed escape, for the error of a failed run
+			std::size_t escapeErrorIndex_ = 0;
+			std::string escapeError_{};
+			ParserState state_{};
+		};
+
+		const std::vector<Instruction>& code() const {
+			return code_;
+		}
+
+	private:
+		struct Compiler;
+
+		std::size_t maxStackDepth_ = 0;
+		std::vector<Instruction> code_;
+		std::vector<std::string> literals_;
+		// FurthestFailure item of each literal, for sink events
+		std::vector<std::uint32_t> literalIds_;
+		std::vector<Parser> escapes_;
+		std::vector<std::function<ParseResult(const ParseResult&)>> maps_;
+		// names of named maps, empty for the others
+		std::vector<std::string> mapNames_;
+
+		template<typename Source>
+		static Task<ParserState> runProgramAsync(Program program, Source& source) {
+			co_return co_await program.runAsync(source);
+		}
+
+		friend struct Parser;
+	};
+
+	template<typename Source>
+	Task<ParserState> Parser::runAsync(Source& source) const {
+		return Program::runProgramAsync(Program::compile(*this), source);
+	}
+}
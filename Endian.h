@@ -0,0 +1,68 @@
+#pragma once
+// little endian integers of the binary files (program images, choice profiles, trace logs),
+// the same bytes on every platform
+#include <algorithm>
+#include <cstdint>
+#include <istream>
+#include <limits>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace Combinators {
+	template<typename T>
+	void writeInt(std::ostream& out, T value) {
+		for (std::size_t i = 0; i < sizeof(T); ++i) {
+			out.put(static_cast<char>((static_cast<std::uint64_t>(value) >> (8 * i)) & 0xff));
+		}
+	}
+
+	// from sizeof(T) bytes
+	template<typename T>
+	T decodeInt(std::string_view bytes) {
+		std::uint64_t value = 0;
+		for (std::size_t i = 0; i < sizeof(T); ++i) {
+			value |= static_cast<std::uint64_t>(static_cast<unsigned char>(bytes[i])) << (8 * i);
+		}
+		return static_cast<T>(value);
+	}
+
+	// throws std::runtime_error with the message at the end of the stream
+	template<typename T>
+	T readInt(std::istream& in, const char* endMessage) {
+		char bytes[sizeof(T)];
+		if (!in.read(bytes, sizeof(T))) {
+			throw std::runtime_error(endMessage);
+		}
+		return decodeInt<T>(std::string_view(bytes, sizeof(T)));
+	}
+
+	// bytes after the read position, the maximum for a stream which can't seek
+	inline std::uint64_t bytesLeft(std::istream& in) {
+		const auto position = in.tellg();
+		if (position == std::istream::pos_type(-1) || !in.seekg(0, std::ios::end)) {
+			in.clear();
+			return std::numeric_limits<std::uint64_t>::max();
+		}
+		const auto end = in.tellg();
+		in.seekg(position);
+		return static_cast<std::uint64_t>(end - position);
+	}
+
+	// a damaged length fails at the end of the stream, the string grows with the bytes read
+	inline std::string readBytes(std::istream& in, std::uint64_t length, const char* endMessage) {
+		if (length > bytesLeft(in)) {
+			throw std::runtime_error(endMessage);
+		}
+		std::string bytes;
+		while (bytes.length() < length) {
+			const auto size = bytes.length();
+			bytes.resize(size + std::min<std::uint64_t>(length - size, 64 * 1024));
+			if (!in.read(bytes.data() + size, bytes.length() - size)) {
+				throw std::runtime_error(endMessage);
+			}
+		}
+		return bytes;
+	}
+}
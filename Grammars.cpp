@@ -0,0 +1,664 @@
+#include <random>
+#include "Grammars.h"
+
+namespace Combinators::Grammars {
+	static constexpr std::array<std::string_view, 4> formatNames{ "json", "csv", "ini", "arithmetic" };
+
+	std::string_view formatName(Format format) {
+		return formatNames[static_cast<std::size_t>(format)];
+	}
+
+	std::optional<Format> parseFormatName(std::string_view name) {
+		for (std::size_t i = 0; i < formatNames.size(); ++i) {
+			if (formatNames[i] == name) {
+				return static_cast<Format>(i);
+			}
+		}
+		return std::nullopt;
+	}
+
+	// the parser without its values
+	static Parser skip(Parser parser) {
+		return parser.map([](const ParseResult&) { return ParseResult{}; });
+	}
+
+	static Parser endOfInput(const std::string& name) {
+		auto endOfInput = [name](const ParserState& state) {
+			if (state.isError) {
+				return state;
+			}
+			if (state.index != state.targetString.length()) {
+				return updateParserError(state, "{}: Expected end of input at index {}", name, state.index);
+			}
+			return updateParserResult(state, {});
+		};
+		return Parser{ endOfInput };
+	}
+
+	// star of single characters, scanned in bulk by the optimizer
+	static Parser spaces(const std::string& characters) {
+		std::vector<Parser> alternatives;
+		for (auto c : characters) {
+			alternatives.push_back(Parsers::str(std::string(1, c)));
+		}
+		return skip(Parsers::star(Parsers::choice(std::as_const(alternatives))));
+	}
+
+	// lines of a line parser, the last one without a line break
+	static Parser lines(const Parser& line, const Parser& lineBreak, const std::string& name) {
+		return Parsers::sequenceOf(
+			Parsers::star(Parsers::sequenceOf(line, skip(lineBreak))),
+			Parsers::choice(endOfInput(name), Parsers::sequenceOf(line, endOfInput(name))));
+	}
+
+	static const Parser& jsonValue() {
+		static const Parser value = [] {
+			auto ws = spaces(" \t\n\r");
+			auto token = [ws](const Parser& parser) {
+				return Parsers::sequenceOf(parser, ws);
+			};
+			auto punctuation = [token](const std::string& text) {
+				return skip(token(Parsers::str(text)));
+			};
+			// item (, item)* or nothing
+			auto list = [punctuation](const Parser& item) {
+				return Parsers::choice(
+					Parsers::sequenceOf(item, Parsers::star(Parsers::sequenceOf(punctuation(","), item))),
+					Parsers::succeed());
+			};
+			auto string = token(Parsers::regexp(
+				std::regex(R"("(?:[^"\\\x00-\x1f]|\\["\\/bfnrt]|\\u[0-9a-fA-F]{4})*")"), "string", 1));
+			auto number = token(Parsers::regexp(
+				std::regex(R"(-?(?:0|[1-9][0-9]*)(?:\.[0-9]+)?(?:[eE][+-]?[0-9]+)?)"), "number", 1));
+			auto value = Parsers::lazy([]() { return jsonValue(); });
+			auto member = Parsers::sequenceOf(string, punctuation(":"), value);
+			return Parsers::choice(
+				Parsers::sequenceOf(punctuation("{"), list(member), punctuation("}")),
+				Parsers::sequenceOf(punctuation("["), list(value), punctuation("]")),
+				string,
+				number,
+				token(Parsers::str("true")),
+				token(Parsers::str("false")),
+				token(Parsers::str("null")));
+		}();
+		return value;
+	}
+
+	Parser json() {
+		return Parsers::sequenceOf(spaces(" \t\n\r"), jsonValue(), endOfInput("json"));
+	}
+
+	Parser csv() {
+		auto field = Parsers::choice(
+			Parsers::regexp(std::regex(R"("(?:[^"]|"")*")"), "quoted field", 1),
+			Parsers::regexp(std::regex(R"([^",\r\n]+)"), "field", 1),
+			// an empty field is a value too
+			Parsers::succeed(ParseResult{ { "" } }));
+		auto record = Parsers::sepBy_plus(Parsers::str(","))(field);
+		return lines(record, Parsers::choice(Parsers::str("\r\n"), Parsers::str("\n")), "csv");
+	}
+
+	Parser ini() {
+		auto hspace = spaces(" \t");
+		auto section = Parsers::between(Parsers::str("["), Parsers::str("]"))(
+			Parsers::regexp(std::regex(R"([^\]\r\n]+)"), "section name", 1));
+		auto comment = skip(Parsers::regexp(std::regex(R"([;#][^\r\n]*)"), "comment", 1));
+		auto pair = Parsers::sequenceOf(
+			Parsers::regexp(std::regex(R"([A-Za-z0-9_.\-]+)"), "key", 1),
+			hspace,
+			skip(Parsers::str("=")),
+			hspace,
+			Parsers::choice(Parsers::regexp(std::regex(R"([^\r\n]+)"), "value", 1), Parsers::succeed(ParseResult{ { "" } })));
+		auto line = Parsers::sequenceOf(hspace, Parsers::choice(section, comment, pair, Parsers::succeed()), hspace);
+		return lines(line, Parsers::choice(Parsers::str("\r\n"), Parsers::str("\n")), "ini");
+	}
+
+	// operand, then operator and operand pairs -> one value
+	static ParseResult fold(const ParseResult& result) {
+		auto value = std::stod(result.values[0]);
+		for (std::size_t i = 1; i + 1 < result.values.size(); i += 2) {
+			const auto operand = std::stod(result.values[i + 1]);
+			switch (result.values[i][0]) {
+			case '+': value += operand; break;
+			case '-': value -= operand; break;
+			case '*': value *= operand; break;
+			default: value /= operand; break;
+			}
+		}
+		return ParseResult{ { std::format("{}", value) } };
+	}
+
+	static Parser arithmeticToken(const Parser& parser) {
+		return Parsers::sequenceOf(parser, spaces(" \t"));
+	}
+
+	static Parser arithmeticOperators(const std::string& operators) {
+		return arithmeticToken(Parsers::choice(Parsers::str(operators.substr(0, 1)), Parsers::str(operators.substr(1, 1))));
+	}
+
+	static const Parser& arithmeticExpression();
+
+	static const Parser& arithmeticFactor() {
+		static const Parser factor = [] {
+			auto number = arithmeticToken(Parsers::regexp(std::regex(R"([0-9]+(?:\.[0-9]+)?)"), "number", 1));
+			return Parsers::choice(
+				number,
+				Parsers::sequenceOf(
+					skip(arithmeticToken(Parsers::str("("))),
+					Parsers::lazy([]() { return arithmeticExpression(); }),
+					skip(arithmeticToken(Parsers::str(")")))),
+				Parsers::sequenceOf(skip(arithmeticToken(Parsers::str("-"))), Parsers::lazy([]() { return arithmeticFactor(); }))
+					.map([](const ParseResult& result) { return ParseResult{ { std::format("{}", -std::stod(result.values[0])) } }; }));
+		}();
+		return factor;
+	}
+
+	static const Parser& arithmeticExpression() {
+		static const Parser expression = [] {
+			auto factor = Parsers::lazy([]() { return arithmeticFactor(); });
+			auto term = Parsers::sequenceOf(factor, Parsers::star(Parsers::sequenceOf(arithmeticOperators("*/"), factor))).map(fold);
+			return Parsers::sequenceOf(term, Parsers::star(Parsers::sequenceOf(arithmeticOperators("+-"), term))).map(fold);
+		}();
+		return expression;
+	}
+
+	Parser arithmetic() {
+		return lines(Parsers::sequenceOf(spaces(" \t"), arithmeticExpression()), Parsers::str("\n"), "arithmetic");
+	}
+
+	Parser grammar(Format format) {
+		switch (format) {
+		case Format::Json:
+			return json();
+		case Format::Csv:
+			return csv();
+		case Format::Ini:
+			return ini();
+		default:
+			return arithmetic();
+		}
+	}
+
+	// hand-written parsers, the same values as the grammars
+	class Baseline
+	{
+	public:
+		explicit Baseline(std::string_view input) : input_(input) {}
+
+		ParserState run(Format format) {
+			bool matched = false;
+			switch (format) {
+			case Format::Json:
+				spaces(" \t\n\r");
+				matched = jsonValue();
+				break;
+			case Format::Csv:
+				matched = lines(&Baseline::csvRecord, "\r\n");
+				break;
+			case Format::Ini:
+				matched = lines(&Baseline::iniLine, "\r\n");
+				break;
+			default:
+				matched = lines(&Baseline::arithmeticLine, "\n");
+				break;
+			}
+			if (!matched || index_ != input_.length()) {
+				return ParserState{ input_, index_, {}, true,
+					std::format("{}: Invalid input at index {}", formatName(format), index_) };
+			}
+			return ParserState{ input_, index_, std::move(result_) };
+		}
+
+	private:
+		std::string_view input_;
+		std::size_t index_ = 0;
+		ParseResult result_;
+
+		bool atEnd() const {
+			return index_ >= input_.length();
+		}
+
+		char peek(std::size_t offset = 0) const {
+			return index_ + offset < input_.length() ? input_[index_ + offset] : '\0';
+		}
+
+		bool isDigit(std::size_t offset = 0) const {
+			return index_ + offset < input_.length() && input_[index_ + offset] >= '0' && input_[index_ + offset] <= '9';
+		}
+
+		void spaces(std::string_view characters) {
+			while (!atEnd() && characters.contains(input_[index_])) {
+				++index_;
+			}
+		}
+
+		bool literal(std::string_view text) {
+			if (!input_.substr(index_).starts_with(text)) {
+				return false;
+			}
+			index_ += text.length();
+			return true;
+		}
+
+		void value(std::size_t begin) {
+			result_ += std::string(input_.substr(begin, index_ - begin));
+		}
+
+		// line (break line)*, a line break at the end is allowed; \r\n or \n for "\r\n"
+		bool lines(bool (Baseline::*line)(), std::string_view lineBreak) {
+			auto skipBreak = [this, lineBreak]() {
+				return (lineBreak.length() == 2 && literal("\r\n")) || literal("\n");
+			};
+			while (!atEnd()) {
+				if (!(this->*line)()) {
+					return false;
+				}
+				if (!atEnd() && !skipBreak()) {
+					return false;
+				}
+			}
+			return true;
+		}
+
+		bool jsonToken(bool matched) {
+			if (matched) {
+				spaces(" \t\n\r");
+			}
+			return matched;
+		}
+
+		// item (, item)* or nothing before the closing bracket
+		bool jsonList(bool (Baseline::*item)(), char close) {
+			if (peek() != close) {
+				if (!(this->*item)()) {
+					return false;
+				}
+				while (peek() == ',') {
+					++index_;
+					spaces(" \t\n\r");
+					if (!(this->*item)()) {
+						return false;
+					}
+				}
+			}
+			return jsonToken(literal(std::string_view(&close, 1)));
+		}
+
+		bool jsonMember() {
+			return jsonString() && jsonToken(literal(":")) && jsonValue();
+		}
+
+		bool jsonString() {
+			const auto begin = index_;
+			if (!literal("\"")) {
+				return false;
+			}
+			while (!atEnd() && peek() != '"') {
+				const auto c = static_cast<unsigned char>(peek());
+				if (c < 0x20) {
+					return false;
+				}
+				if (c != '\\') {
+					++index_;
+					continue;
+				}
+				const auto escaped = peek(1);
+				if (std::string_view("\"\\/bfnrt").contains(escaped)) {
+					index_ += 2;
+				}
+				else if (escaped == 'u' && std::ranges::all_of(std::string_view("2345"),
+					[this](char offset) { return std::isxdigit(static_cast<unsigned char>(peek(offset - '0'))) != 0; })) {
+					index_ += 6;
+				}
+				else {
+					return false;
+				}
+			}
+			if (!literal("\"")) {
+				return false;
+			}
+			value(begin);
+			return jsonToken(true);
+		}
+
+		bool jsonNumber() {
+			const auto begin = index_;
+			literal("-");
+			if (literal("0")) {
+			}
+			else if (isDigit()) {
+				while (isDigit()) {
+					++index_;
+				}
+			}
+			else {
+				index_ = begin;
+				return false;
+			}
+			if (peek() == '.' && isDigit(1)) {
+				index_ += 1;
+				while (isDigit()) {
+					++index_;
+				}
+			}
+			if (peek() == 'e' || peek() == 'E') {
+				const std::size_t sign = peek(1) == '+' || peek(1) == '-' ? 1 : 0;
+				if (isDigit(1 + sign)) {
+					index_ += 1 + sign;
+					while (isDigit()) {
+						++index_;
+					}
+				}
+			}
+			value(begin);
+			return jsonToken(true);
+		}
+
+		bool jsonValue() {
+			const auto begin = index_;
+			switch (peek()) {
+			case '{':
+				++index_;
+				spaces(" \t\n\r");
+				return jsonList(&Baseline::jsonMember, '}');
+			case '[':
+				++index_;
+				spaces(" \t\n\r");
+				return jsonList(&Baseline::jsonValue, ']');
+			case '"':
+				return jsonString();
+			default:
+				if (literal("true") || literal("false") || literal("null")) {
+					value(begin);
+					return jsonToken(true);
+				}
+				return jsonNumber();
+			}
+		}
+
+		bool csvRecord() {
+			while (true) {
+				const auto begin = index_;
+				if (literal("\"")) {
+					while (true) {
+						if (atEnd()) {
+							return false;
+						}
+						if (peek() == '"' && peek(1) == '"') {
+							index_ += 2;
+						}
+						else if (peek() == '"') {
+							++index_;
+							break;
+						}
+						else {
+							++index_;
+						}
+					}
+				}
+				else {
+					while (!atEnd() && !std::string_view("\",\r\n").contains(peek())) {
+						++index_;
+					}
+				}
+				value(begin);
+				if (!literal(",")) {
+					return true;
+				}
+			}
+		}
+
+		bool iniLine() {
+			spaces(" \t");
+			const auto begin = index_;
+			auto restOfLine = [this]() {
+				while (!atEnd() && peek() != '\r' && peek() != '\n') {
+					++index_;
+				}
+			};
+			if (peek() == '[') {
+				++index_;
+				const auto nameBegin = index_;
+				while (!atEnd() && !std::string_view("]\r\n").contains(peek())) {
+					++index_;
+				}
+				if (index_ > nameBegin && peek() == ']') {
+					value(nameBegin);
+					++index_;
+					spaces(" \t");
+					return true;
+				}
+				index_ = begin;
+			}
+			if (peek() == ';' || peek() == '#') {
+				restOfLine();
+				return true;
+			}
+			while (!atEnd() && (std::isalnum(static_cast<unsigned char>(peek())) || std::string_view("_.-").contains(peek()))) {
+				++index_;
+			}
+			if (index_ == begin) {
+				// a blank line
+				return true;
+			}
+			value(begin);
+			spaces(" \t");
+			if (!literal("=")) {
+				return false;
+			}
+			spaces(" \t");
+			const auto valueBegin = index_;
+			restOfLine();
+			value(valueBegin);
+			return true;
+		}
+
+		bool arithmeticLine() {
+			spaces(" \t");
+			double result = 0;
+			if (!arithmeticExpression(result)) {
+				return false;
+			}
+			result_ += std::format("{}", result);
+			return true;
+		}
+
+		bool arithmeticExpression(double& result) {
+			if (!arithmeticTerm(result)) {
+				return false;
+			}
+			while (peek() == '+' || peek() == '-') {
+				const auto op = peek();
+				++index_;
+				spaces(" \t");
+				double operand = 0;
+				if (!arithmeticTerm(operand)) {
+					return false;
+				}
+				result = op == '+' ? result + operand : result - operand;
+			}
+			return true;
+		}
+
+		bool arithmeticTerm(double& result) {
+			if (!arithmeticFactor(result)) {
+				return false;
+			}
+			while (peek() == '*' || peek() == '/') {
+				const auto op = peek();
+				++index_;
+				spaces(" \t");
+				double operand = 0;
+				if (!arithmeticFactor(operand)) {
+					return false;
+				}
+				result = op == '*' ? result * operand : result / operand;
+			}
+			return true;
+		}
+
+		bool arithmeticFactor(double& result) {
+			if (isDigit()) {
+				const auto begin = index_;
+				while (isDigit()) {
+					++index_;
+				}
+				if (peek() == '.' && isDigit(1)) {
+					++index_;
+					while (isDigit()) {
+						++index_;
+					}
+				}
+				result = std::stod(std::string(input_.substr(begin, index_ - begin)));
+				spaces(" \t");
+				return true;
+			}
+			if (literal("(")) {
+				spaces(" \t");
+				if (!arithmeticExpression(result) || !literal(")")) {
+					return false;
+				}
+				spaces(" \t");
+				return true;
+			}
+			if (literal("-")) {
+				spaces(" \t");
+				if (!arithmeticFactor(result)) {
+					return false;
+				}
+				result = -result;
+				return true;
+			}
+			return false;
+		}
+	};
+
+	ParserState baseline(Format format, std::string_view input) {
+		return Baseline(input).run(format);
+	}
+
+	class CorpusWriter
+	{
+	public:
+		CorpusWriter(std::size_t size, std::uint64_t seed) : size_(size), random_(seed) {}
+
+		std::string json() {
+			text_ += "[\n";
+			for (std::size_t record = 0; text_.length() < size_; ++record) {
+				if (record != 0) {
+					text_ += ",\n";
+				}
+				text_ += std::format("  {{\"id\": {}, \"name\": \"{}\", \"score\": {}, \"active\": {}, \"parent\": null,\n",
+					record, word(), number(), below(2) == 0 ? "true" : "false");
+				text_ += std::format("   \"tags\": [{}], \"address\": {{\"city\": \"{}\", \"zip\": \"{:05}\"}},\n",
+					wordList(", ", "\""), word(), below(100000));
+				text_ += std::format("   \"note\": \"{} \\\"{}\\\" \\u00e9\\n{}\", \"empty\": {{}}, \"matrix\": [[{}, {}], []]}}",
+					word(), word(), word(), number(), number());
+			}
+			text_ += "\n]\n";
+			return std::move(text_);
+		}
+
+		std::string csv() {
+			text_ += "id,name,quoted,escaped,empty,amount\r\n";
+			for (std::size_t record = 0; text_.length() < size_; ++record) {
+				text_ += std::format("{},{},\"{}, {}\",\"{} \"\"{}\"\"\",,{}\r\n", record, word(), word(), word(), word(), word(), number());
+			}
+			return std::move(text_);
+		}
+
+		std::string ini() {
+			for (std::size_t section = 0; text_.length() < size_; ++section) {
+				text_ += std::format("[section {}]\n; {}\n", section, wordList(" ", ""));
+				const auto pairs = 2 + below(6);
+				for (std::size_t pair = 0; pair < pairs; ++pair) {
+					text_ += std::format("{}{}_{} = {}\n", below(4) == 0 ? "  " : "", word(), pair, wordList(" ", ""));
+				}
+				text_ += below(2) == 0 ? "\n" : "# end\n";
+			}
+			return std::move(text_);
+		}
+
+		std::string arithmetic() {
+			while (text_.length() < size_) {
+				expression(0);
+				text_ += "\n";
+			}
+			return std::move(text_);
+		}
+
+	private:
+		std::size_t size_;
+		std::mt19937_64 random_;
+		std::string text_;
+
+		std::size_t below(std::size_t limit) {
+			return static_cast<std::size_t>(random_() % limit);
+		}
+
+		std::string word() {
+			static constexpr std::string_view syllables[] = { "ka", "lo", "mi", "ne", "ru", "ta", "vo", "zen", "shi", "ber" };
+			std::string word;
+			for (std::size_t i = 0, count = 1 + below(3); i < count; ++i) {
+				word += syllables[below(std::size(syllables))];
+			}
+			return word;
+		}
+
+		std::string wordList(std::string_view separator, std::string_view quote) {
+			std::string list;
+			for (std::size_t i = 0, count = 1 + below(4); i < count; ++i) {
+				list += std::format("{}{}{}{}", i == 0 ? "" : separator, quote, word(), quote);
+			}
+			return list;
+		}
+
+		std::string number() {
+			switch (below(3)) {
+			case 0:
+				return std::format("{}", below(100000));
+			case 1:
+				return std::format("-{}.{}", below(1000), below(100));
+			default:
+				return std::format("{}.{}e{}", 1 + below(9), below(1000), below(10));
+			}
+		}
+
+		// nonzero divisors, parentheses a few levels deep
+		void expression(std::size_t depth) {
+			for (std::size_t term = 0, terms = 1 + below(4); term < terms; ++term) {
+				if (term != 0) {
+					text_ += below(2) == 0 ? " + " : " - ";
+				}
+				for (std::size_t factor = 0, factors = 1 + below(3); factor < factors; ++factor) {
+					if (factor != 0) {
+						text_ += below(2) == 0 ? " * " : " / ";
+						text_ += std::format("{}", 1 + below(99));
+					}
+					else if (depth < 3 && below(4) == 0) {
+						text_ += below(3) == 0 ? "-(" : "(";
+						expression(depth + 1);
+						text_ += ")";
+					}
+					else {
+						text_ += std::format("{}.{}", below(1000), below(10));
+					}
+				}
+			}
+		}
+	};
+
+	std::string corpus(Format format, std::size_t size, std::uint64_t seed) {
+		CorpusWriter writer(size, seed);
+		switch (format) {
+		case Format::Json:
+			return writer.json();
+		case Format::Csv:
+			return writer.csv();
+		case Format::Ini:
+			return writer.ini();
+		default:
+			return writer.arithmetic();
+		}
+	}
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <cstdint>
+#include <optional>
+#include "ParserCombinators.h"
+
+// reference grammars built with Parsers, with input generators and hand-written baselines for comparisons
+namespace Combinators::Grammars {
+	enum class Format {
+		Json,
+		Csv,
+		Ini,
+		Arithmetic
+	};
+
+	// lowercase name of the format: "json", "csv", "ini" or "arithmetic"
+	std::string_view formatName(Format format);
+	// std::nullopt for other names
+	std::optional<Format> parseFormatName(std::string_view name);
+
+	// JSON (RFC 8259) - string, number, true, false and null values in document order,
+	// strings with their quotes and escapes as written
+	Parser json();
+	// CSV (RFC 4180, LF line breaks accepted too) - the fields of every record as written, quoted ones with the quotes
+	Parser csv();
+	// INI - section names and the key and value of each pair in order; ; and # comments, blank lines
+	Parser ini();
+	// lines of + - * / and parentheses over decimal numbers - the value of each line as std::format("{}", double)
+	Parser arithmetic();
+	// all of them must match the whole input
+	Parser grammar(Format format);
+
+	// deterministic input of about size bytes (a little more to close the last element)
+	std::string corpus(Format format, std::size_t size, std::uint64_t seed = 1);
+
+	// hand-written recursive descent parser of the same language, giving the same values and index
+	// as grammar(format) for valid input; errors only have a short message
+	ParserState baseline(Format format, std::string_view input);
+}
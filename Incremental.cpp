@@ -0,0 +1,19 @@
+#include "Incremental.h"
+
+namespace Combinators {
+	IncrementalParser::IncrementalParser(const Parser& parser, std::string text)
+		: parser_(parser), text_(std::move(text)) {
+	}
+
+	ParserState IncrementalParser::parse() {
+		RunContext context{ .memo = &memo_, .shareResults = true };
+		return parser_.run(text_, context);
+	}
+
+	ParserState IncrementalParser::edit(std::size_t offset, std::size_t removed, const std::string_view& inserted) {
+		assert(offset + removed <= text_.length());
+		text_.replace(offset, removed, inserted);
+		memo_.edit(offset, removed, inserted.length());
+		return parse();
+	}
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include "ParserCombinators.h"
+
+namespace Combinators {
+	// Owns the document and the memo table of the previous run.
+	// After an edit only the Parsers::memo rules touching the edited range are parsed again,
+	// the results after it are reused with shifted offsets. The memo table edit touches the results near the
+	// edit only (see MemoTable), loops hop over their unchanged iterations (see LoopChunks) and the reused
+	// results are spliced into the result of the document by reference: its values are in ParseResult::parts,
+	// flattened() gives them in one vector.
+	class IncrementalParser
+	{
+	public:
+		IncrementalParser(const Parser& parser, std::string text);
+
+		ParserState parse();
+		// replace removed characters at offset with inserted text and parse again
+		ParserState edit(std::size_t offset, std::size_t removed, const std::string_view& inserted);
+
+		const std::string& text() const {
+			return text_;
+		}
+
+		const MemoTable& memo() const {
+			return memo_;
+		}
+
+	private:
+		Parser parser_;
+		std::string text_;
+		MemoTable memo_;
+	};
+}
@@ -0,0 +1,158 @@
+#include <stdexcept>
+#include "Lexer.h"
+
+namespace Combinators {
+	std::uint32_t Lexer::add(Definition&& definition) {
+		const auto kind = static_cast<std::uint32_t>(definitions_.size());
+		if (definition.isLiteral) {
+			candidates_[static_cast<unsigned char>(definition.literal.front())].push_back(kind);
+		}
+		else {
+			// the first byte of a regexp match is unknown, try it everywhere
+			for (auto& candidates : candidates_) {
+				candidates.push_back(kind);
+			}
+		}
+		definitions_.push_back(std::move(definition));
+		return kind;
+	}
+
+	std::uint32_t Lexer::str(const std::string& literal) {
+		// the candidates are found by the first byte
+		if (literal.empty()) {
+			throw std::invalid_argument("lexer: Empty literal token");
+		}
+		return add(Definition{ std::format("\"{}\"", literal), literal, {}, true });
+	}
+
+	std::uint32_t Lexer::regexp(const std::regex& re, const std::string_view& name) {
+		return add(Definition{ std::string(name), {}, re });
+	}
+
+	void Lexer::skip(const std::regex& re) {
+		add(Definition{ "skip", {}, re, false, true });
+	}
+
+	const std::string& Lexer::name(std::uint32_t kind) const {
+		return definitions_[kind].name;
+	}
+
+	TokenStream Lexer::tokenize(const std::string_view& targetString) const {
+		TokenStream stream{ targetString };
+		// tokens keep 32 bit offsets and lengths
+		if (targetString.length() > std::numeric_limits<std::uint32_t>::max()) {
+			stream.isError = true;
+			stream.error = std::format("lexer: Input of {} bytes is over the 4 GB tokens can address", targetString.length());
+			return stream;
+		}
+		std::size_t index = 0;
+		while (index < targetString.length()) {
+			std::size_t bestLength = 0;
+			std::uint32_t bestKind = 0;
+			for (auto kind : candidates_[static_cast<unsigned char>(targetString[index])]) {
+				const auto& definition = definitions_[kind];
+				std::size_t length = 0;
+				if (definition.isLiteral) {
+					if (targetString.substr(index).starts_with(definition.literal)) {
+						length = definition.literal.length();
+					}
+				}
+				else {
+					std::cmatch match;
+					if (std::regex_search(targetString.data() + index, targetString.data() + targetString.length(),
+						match, definition.re, std::regex_constants::match_continuous)) {
+						length = match[0].length();
+					}
+				}
+				if (length > bestLength) {
+					bestLength = length;
+					bestKind = kind;
+				}
+			}
+			if (bestLength == 0) {
+				stream.isError = true;
+				stream.error = std::format("lexer: Couldn't match any token at index {}", index);
+				return stream;
+			}
+			if (!definitions_[bestKind].isSkipped) {
+				stream.tokens.push_back(Token{
+					bestKind,
+					static_cast<std::uint32_t>(index),
+					static_cast<std::uint32_t>(bestLength)
+				});
+			}
+			index += bestLength;
+		}
+		return stream;
+	}
+
+	Parser Lexer::token(std::uint32_t kind) const {
+		const auto& name = definitions_[kind].name;
+		auto token = [kind, name, itemId = FurthestFailure::itemId(name)](const ParserState& state) {
+			if (state.isError) {
+				return state;
+			}
+			countInvocation(state);
+			const auto* stream = state.context != nullptr ? state.context->tokens : nullptr;
+			if (stream == nullptr) {
+				return updateParserError(state,
+					"token: Tried to match {} without a token stream.", name);
+			}
+			if (state.index >= stream->tokens.size()) {
+				state.context->failure.add(stream->source.length(), itemId);
+				return updateParserFailure(state,
+					"token: Tried to match {}, but got unexpected end of input.", name);
+			}
+			const auto& next = stream->tokens[state.index];
+			if (next.kind != kind) {
+				state.context->failure.add(next.offset, itemId);
+				return updateParserFailure(state,
+					"token: Tried to match {}, but got \"{}\" at index {}",
+						name, stream->text(next), next.offset);
+			}
+			if (skipValues(state)) {
+				return updateParserMatch(state, state.index + 1, {}, itemId);
+			}
+			return updateParserMatch(state, state.index + 1, std::string(stream->text(next)), itemId);
+		};
+		return Parser{ token };
+	}
+
+	Parser Lexer::anyToken() const {
+		auto anyToken = [itemId = FurthestFailure::itemId("any token")](const ParserState& state) {
+			if (state.isError) {
+				return state;
+			}
+			countInvocation(state);
+			const auto* stream = state.context != nullptr ? state.context->tokens : nullptr;
+			if (stream == nullptr || state.index >= stream->tokens.size()) {
+				return updateParserError(state, "anyToken: Got unexpected end of input.");
+			}
+			if (skipValues(state)) {
+				return updateParserMatch(state, state.index + 1, {}, itemId);
+			}
+			return updateParserMatch(state, state.index + 1, std::string(stream->text(stream->tokens[state.index])), itemId);
+		};
+		return Parser{ anyToken };
+	}
+
+	ParserState Parser::run(const TokenStream& tokens) const {
+		RunContext context{};
+		return run(tokens, context);
+	}
+
+	ParserState Parser::run(const TokenStream& tokens, RunContext& context) const {
+		if (tokens.isError) {
+			return ParserState{ tokens.source, 0, {}, true, tokens.error };
+		}
+		context.tokens = &tokens;
+		context.startRun(tokens.source);
+		return countRunStats(context, [&]() {
+			ParserState initialState{ tokens.source, 0, {}, false, {}, &context };
+			auto finalState = transformerFn(initialState);
+			finalState.error = errorMessage(finalState);
+			finalState.context = nullptr;
+			return finalState;
+		});
+	}
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include "ParserCombinators.h"
+
+namespace Combinators {
+	struct Token
+	{
+		std::uint32_t kind = 0;
+		std::uint32_t offset = 0;
+		std::uint32_t length = 0;
+		bool operator==(const Token&) const = default;
+	};
+
+	struct TokenStream
+	{
+		std::string_view source;
+		std::vector<Token> tokens{};
+		// error stuff
+		bool isError = false;
+		std::string error{};
+
+		std::string_view text(const Token& token) const {
+			return source.substr(token.offset, token.length);
+		}
+	};
+
+	// Splits the input into a flat token array in one pass.
+	// At every position the longest matching definition wins, on equal length the first declared one.
+	// Literal definitions are only tried when the current byte is their first byte.
+	class Lexer
+	{
+	public:
+		// token definitions, return the token kind; str throws std::invalid_argument for an empty literal
+		std::uint32_t str(const std::string& literal);
+		std::uint32_t regexp(const std::regex& re, const std::string_view& name = "regexp");
+		// matched input is dropped from the token stream (whitespace, comments)
+		void skip(const std::regex& re);
+
+		// an error stream for inputs over 4 GB, the tokens have 32 bit offsets
+		TokenStream tokenize(const std::string_view& targetString) const;
+
+		const std::string& name(std::uint32_t kind) const;
+
+		// token parser = matches one token of the kind, index is a token index
+		Parser token(std::uint32_t kind) const;
+		// matches any single token
+		Parser anyToken() const;
+
+	private:
+		struct Definition
+		{
+			std::string name{};
+			std::string literal{};
+			std::regex re{};
+			bool isLiteral = false;
+			bool isSkipped = false;
+		};
+
+		std::uint32_t add(Definition&& definition);
+
+		std::vector<Definition> definitions_;
+		// definitions to try by the first byte of the input
+		std::array<std::vector<std::uint32_t>, 256> candidates_;
+	};
+}
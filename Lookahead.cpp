@@ -0,0 +1,90 @@
+#include "ParserCombinators.h"
+#include "Lexer.h"
+
+namespace Combinators {
+	// runs the parser in recognition mode, without Ast nodes and sink events
+	static ParserState runRecognizing(const Parser& parser, const ParserState& state) {
+		auto* context = state.context;
+		if (context == nullptr) {
+			return parser.transformerFn(state);
+		}
+		const bool recognizing = std::exchange(context->recognizing, true);
+		auto* ast = std::exchange(context->ast, nullptr);
+		auto* sink = std::exchange(context->sink, nullptr);
+		auto nextState = parser.transformerFn(state);
+		context->recognizing = recognizing;
+		context->ast = ast;
+		context->sink = sink;
+		return nextState;
+	}
+
+	Parser Parsers::peek(const Parser& parser) {
+		auto peek = [parser](const ParserState& state) {
+			if (state.isError) {
+				return state;
+			}
+			const auto nextState = runRecognizing(parser, state);
+			if (isAborted(nextState)) {
+				return nextState;
+			}
+			if (nextState.isError) {
+				return updateParserError(state, "peek: Parser didn't match at index {}", state.index);
+			}
+			return updateParserState(state, state.index, {});
+		};
+		return Parser{ peek, node(GrammarNode::Kind::Peek, { parser }) };
+	}
+
+	Parser Parsers::notFollowedBy(const Parser& parser) {
+		auto notFollowedBy = [parser](const ParserState& state) {
+			if (state.isError) {
+				return state;
+			}
+			// what the parser expected isn't what the run expects
+			const auto failure = state.context != nullptr ? state.context->failure : FurthestFailure{};
+			const auto nextState = runRecognizing(parser, state);
+			if (isAborted(nextState)) {
+				return nextState;
+			}
+			if (state.context != nullptr) {
+				state.context->failure = failure;
+			}
+			if (!nextState.isError) {
+				return updateParserError(state, "notFollowedBy: Parser matched at index {}", state.index);
+			}
+			return updateParserState(state, state.index, {});
+		};
+		return Parser{ notFollowedBy, node(GrammarNode::Kind::NotFollowedBy, { parser }) };
+	}
+
+	Parser Parsers::recognize(const Parser& parser) {
+		auto recognize = [parser, itemId = FurthestFailure::itemId("recognize")](const ParserState& state) {
+			if (state.isError) {
+				return state;
+			}
+			const auto nextState = runRecognizing(parser, state);
+			if (isAborted(nextState)) {
+				return nextState;
+			}
+			if (nextState.isError) {
+				return updateParserError(state, "recognize: Parser didn't match at index {}", state.index);
+			}
+			// one copy of the span, none in sink and recognition mode
+			if (skipValues(state)) {
+				return updateParserMatch(state, nextState.index, {}, itemId);
+			}
+			const auto* stream = state.context != nullptr ? state.context->tokens : nullptr;
+			if (stream == nullptr) {
+				return updateParserMatch(state, nextState.index, std::string(state.targetString.substr(state.index, nextState.index - state.index)), itemId);
+			}
+			if (nextState.index == state.index) {
+				return updateParserMatch(state, nextState.index, {}, itemId);
+			}
+			const auto& first = stream->tokens[state.index];
+			const auto& last = stream->tokens[nextState.index - 1];
+			return updateParserMatch(state, nextState.index,
+				std::string(stream->source.substr(first.offset, last.offset + last.length - first.offset)), itemId);
+		};
+		return Parser{ recognize, node(GrammarNode::Kind::Recognize, { parser }) };
+	}
+}
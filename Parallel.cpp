@@ -0,0 +1,334 @@
+#include <atomic>
+#include <bit>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include "ParserCombinators.h"
+#include "Simd.h"
+#include "Trace.h"
+
+namespace Combinators {
+	struct Span
+	{
+		std::size_t begin;
+		std::size_t end;
+	};
+
+	static constexpr std::string_view structuralBytes = "\"\\()[]{}";
+
+	// index of the next byte which can change the nesting or end an element
+	static std::size_t nextStructural(const std::string_view& text, std::size_t index,
+		const std::array<bool, 256>& structural, std::optional<char> separator) {
+#ifdef COMBINATORS_SSE2
+		// 16 bytes per step, one bit per structural byte
+		const auto separatorBytes = _mm_set1_epi8(separator.value_or('"'));
+		for (; index + 16 <= text.length(); index += 16) {
+			const auto chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text.data() + index));
+			auto found = _mm_cmpeq_epi8(chunk, separatorBytes);
+			for (auto byte : structuralBytes) {
+				found = _mm_or_si128(found, _mm_cmpeq_epi8(chunk, _mm_set1_epi8(byte)));
+			}
+			if (const auto mask = static_cast<unsigned>(_mm_movemask_epi8(found)); mask != 0) {
+				return index + std::countr_zero(mask);
+			}
+		}
+#endif
+		while (index < text.length() && !structural[static_cast<unsigned char>(text[index])]) {
+			++index;
+		}
+		return index;
+	}
+
+	// spans of the top level elements of a list starting at index, empty when the nesting doesn't close.
+	// with a separator the elements end at separators, without one after each closed bracket;
+	// the list ends at an unmatched closing bracket or at the end of the input
+	static std::vector<Span> scanElements(const std::string_view& text, std::size_t index, std::optional<char> separator) {
+		std::array<bool, 256> structural{};
+		for (auto byte : structuralBytes) {
+			structural[static_cast<unsigned char>(byte)] = true;
+		}
+		if (separator) {
+			structural[static_cast<unsigned char>(*separator)] = true;
+		}
+		std::vector<Span> spans;
+		auto begin = index;
+		std::size_t depth = 0;
+		bool quoted = false;
+		for (index = nextStructural(text, index, structural, separator); index < text.length();
+			index = nextStructural(text, index + 1, structural, separator)) {
+			const char byte = text[index];
+			if (quoted) {
+				if (byte == '\\') {
+					++index;
+				}
+				else if (byte == '"') {
+					quoted = false;
+				}
+			}
+			else if (byte == '"') {
+				quoted = true;
+			}
+			else if (byte == '(' || byte == '[' || byte == '{') {
+				++depth;
+			}
+			else if (byte == ')' || byte == ']' || byte == '}') {
+				if (depth == 0) {
+					spans.push_back(Span{ begin, index });
+					return spans;
+				}
+				if (--depth == 0 && !separator) {
+					spans.push_back(Span{ begin, index + 1 });
+					begin = index + 1;
+				}
+			}
+			else if (depth == 0 && separator && byte == *separator) {
+				spans.push_back(Span{ begin, index });
+				begin = index + 1;
+			}
+		}
+		if (quoted || depth != 0) {
+			return {};
+		}
+		spans.push_back(Span{ begin, text.length() });
+		return spans;
+	}
+
+	// Worker threads of all parallel lists, started by the first one and grown to the most threads asked for.
+	// A list runs on the calling thread and the free workers, so a list inside a list element doesn't wait for
+	// workers busy with the outer list.
+	class WorkerPool
+	{
+	public:
+		static WorkerPool& instance() {
+			static WorkerPool pool;
+			return pool;
+		}
+
+		// fn(participant) on the calling thread (participant 0) and on up to helpers workers (1..helpers);
+		// fn takes its work from a shared counter, as workers can join late or not at all.
+		// Returns when every call which started is done
+		void run(std::size_t helpers, const std::function<void(std::size_t)>& fn) {
+			Job job{ &fn, helpers };
+			{
+				std::lock_guard lock(mutex_);
+				while (workers_.size() < helpers) {
+					workers_.emplace_back([this](std::stop_token stop) { work(stop); });
+				}
+				if (helpers != 0) {
+					jobs_.push_back(&job);
+				}
+			}
+			ready_.notify_all();
+			fn(0);
+			std::unique_lock lock(mutex_);
+			std::erase(jobs_, &job);
+			done_.wait(lock, [&job]() { return job.active == 0; });
+		}
+
+	private:
+		struct Job
+		{
+			const std::function<void(std::size_t)>* fn;
+			std::size_t helpers;
+			std::size_t started = 0;
+			std::size_t active = 0;
+		};
+
+		void work(std::stop_token stop) {
+			std::unique_lock lock(mutex_);
+			while (ready_.wait(lock, stop, [this]() { return !jobs_.empty(); })) {
+				auto& job = *jobs_.front();
+				const auto participant = ++job.started;
+				if (job.started == job.helpers) {
+					jobs_.pop_front();
+				}
+				++job.active;
+				lock.unlock();
+				(*job.fn)(participant);
+				lock.lock();
+				--job.active;
+				done_.notify_all();
+			}
+		}
+
+		std::mutex mutex_;
+		std::condition_variable_any ready_;
+		std::condition_variable done_;
+		std::deque<Job*> jobs_;
+		// destroyed first, the workers stop before the rest goes
+		std::vector<std::jthread> workers_;
+	};
+
+	// what the workers counted, traced and expected, added to the run when it keeps their elements
+	struct WorkerOutput
+	{
+		std::vector<std::size_t> examined;
+		std::vector<RunStats> stats;
+		std::vector<FurthestFailure> failures;
+		std::vector<std::optional<TraceBuffer>> traces;
+		std::vector<std::uint64_t> steps;
+
+		explicit WorkerOutput(std::size_t threads)
+			: examined(threads), stats(threads), failures(threads), traces(threads), steps(threads) {}
+
+		void addTo(RunContext& context) const {
+			context.examined = std::max(context.examined, std::ranges::max(examined));
+			for (std::size_t worker = 0; worker < stats.size(); ++worker) {
+				if (context.stats != nullptr) {
+					*context.stats += stats[worker];
+				}
+				if (context.trace != nullptr && traces[worker]) {
+					context.trace->append(*traces[worker]);
+				}
+				for (std::size_t i = 0; i < failures[worker].count; ++i) {
+					context.failure.add(failures[worker].index, failures[worker].expected[i]);
+				}
+				// the next countStep of the run checks the limits
+				context.steps += steps[worker];
+			}
+		}
+	};
+
+	// parses every span on the worker threads, false when an element before the last doesn't fill its span or a
+	// worker reached a limit. The workers run with the settings of the run (depth, deadline, modes), a share of
+	// its steps left each and their own stats, trace and failures. Those stay out of the run when it parses
+	// sequentially instead; the parallel work then costs at most the steps left once more
+	static bool parseElements(const ParserState& state, const Parser& valueParser, const std::vector<Span>& spans,
+		std::size_t threads, std::vector<ParserState>& elements, WorkerOutput& output) {
+		const auto count = spans.size();
+		// small batches, idle workers take the next one
+		const auto batch = std::max<std::size_t>(1, count / (threads * 8));
+		std::atomic<std::size_t> next = 0;
+		std::atomic<bool> failed = false;
+		std::vector<std::exception_ptr> exceptions(threads);
+		const RunContext defaults{};
+		const auto& outer = state.context != nullptr ? *state.context : defaults;
+		const auto unlimited = std::numeric_limits<std::uint64_t>::max();
+		const auto maxSteps = outer.maxSteps == unlimited ? unlimited : (outer.maxSteps - std::min(outer.steps, outer.maxSteps)) / threads;
+		elements.resize(count);
+		WorkerPool::instance().run(threads - 1, [&](std::size_t worker) {
+			RunContext context{ .lines = LineIndex(state.targetString), .depth = outer.depth, .maxDepth = outer.maxDepth,
+				.utf8 = outer.utf8, .stats = outer.stats != nullptr ? &output.stats[worker] : nullptr,
+				.recognizing = outer.recognizing, .maxSteps = maxSteps, .deadline = outer.deadline, .stop = outer.stop };
+			if (outer.trace != nullptr) {
+				context.trace = &output.traces[worker].emplace(outer.trace->capacity());
+			}
+			// the allocations of the caller are counted by the run, the ones of the workers here
+			const auto [allocations, allocatedBytes] = allocationCounters();
+			try {
+				for (auto first = next.fetch_add(batch); first < count && !failed; first = next.fetch_add(batch)) {
+					for (auto i = first; i < std::min(first + batch, count); ++i) {
+						auto& element = elements[i];
+						element = valueParser.transformerFn(
+							ParserState{ state.targetString, spans[i].begin, {}, false, {}, &context });
+						element.context = nullptr;
+						// the last element can end anywhere (or fail for star)
+						if (context.aborted || (i + 1 < count && (element.isError || element.index != spans[i].end))) {
+							failed = true;
+							break;
+						}
+					}
+				}
+			}
+			catch (...) {
+				exceptions[worker] = std::current_exception();
+				failed = true;
+			}
+			if (worker != 0) {
+				const auto [allocationsAfter, allocatedBytesAfter] = allocationCounters();
+				output.stats[worker].allocations += allocationsAfter - allocations;
+				output.stats[worker].allocatedBytes += allocatedBytesAfter - allocatedBytes;
+			}
+			output.examined[worker] = context.examined;
+			output.failures[worker] = context.failure;
+			output.steps[worker] = context.steps;
+		});
+		for (auto& exception : exceptions) {
+			if (exception) {
+				std::rethrow_exception(exception);
+			}
+		}
+		return !failed;
+	}
+
+	Parser Parsers::parallel(const Parser& parser, const ParallelOptions& options) {
+		using Kind = GrammarNode::Kind;
+		if (parser.node == nullptr) {
+			return parser;
+		}
+		const auto kind = parser.node->kind;
+		Parser separatorParser;
+		Parser valueParser;
+		std::optional<char> separator;
+		if (kind == Kind::SepByStar || kind == Kind::SepByPlus) {
+			separatorParser = parser.node->children[0];
+			valueParser = parser.node->children[1];
+			const auto* separatorNode = separatorParser.node.get();
+			if (separatorNode == nullptr || separatorNode->kind != Kind::Str || separatorNode->text.length() != 1
+				|| structuralBytes.contains(separatorNode->text[0])) {
+				return parser;
+			}
+			separator = separatorNode->text[0];
+		}
+		else if (kind == Kind::Star || kind == Kind::Plus) {
+			valueParser = parser.node->children[0];
+		}
+		else {
+			return parser;
+		}
+		const bool atLeastOne = kind == Kind::SepByPlus || kind == Kind::Plus;
+		const auto threads = options.threads != 0 ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+
+		auto parallel = [parser, separatorParser, valueParser, separator, atLeastOne, threads, options](const ParserState& state) {
+			if (state.isError) {
+				return state;
+			}
+			// Ast nodes and sink events have to come in input order
+			const bool sequential = state.context != nullptr
+				&& (state.context->tokens != nullptr || state.context->ast != nullptr || state.context->sink != nullptr);
+			if (sequential || threads < 2 || state.targetString.length() - state.index < options.minBytes) {
+				return parser.transformerFn(state);
+			}
+			const auto spans = scanElements(state.targetString, state.index, separator);
+			if (spans.size() < options.minElements) {
+				return parser.transformerFn(state);
+			}
+			std::vector<ParserState> elements;
+			WorkerOutput output(threads);
+			if (!parseElements(state, valueParser, spans, threads, elements, output)) {
+				return parser.transformerFn(state);
+			}
+			// the sequential loop has to stop after the last element too
+			auto count = elements.size();
+			auto& last = elements.back();
+			auto index = last.index;
+			if (separator) {
+				if (last.isError || !separatorParser.transformerFn(updateParserState(state, index, {})).isError) {
+					return parser.transformerFn(state);
+				}
+			}
+			else if (last.isError) {
+				--count;
+				index = spans.back().begin;
+			}
+			else if (!valueParser.transformerFn(updateParserState(state, index, {})).isError) {
+				return parser.transformerFn(state);
+			}
+			if (atLeastOne && count == 0) {
+				return parser.transformerFn(state);
+			}
+			if (state.context != nullptr) {
+				output.addTo(*state.context);
+			}
+			ParseResult result;
+			for (std::size_t i = 0; i < count; ++i) {
+				result += elements[i].result;
+			}
+			return updateParserState(state, index, result);
+		};
+		return Parser{ parallel };
+	}
+}
@@ -1,13 +1,190 @@
 ﻿// ParserCombinations.cpp: определяет точку входа для приложения.
 //
+#include <atomic>
+#include <span>
+#include <bit>
+#include <cstring>
+#include <stdexcept>
 #include "ParserCombinators.h"
+#include "Simd.h"
+#include "Analysis.h"
 
 namespace Combinators {
+	// memo rules depend on the input up to the furthest examined character
+	static void markExamined(const ParserState& state, std::size_t end) {
+		if (state.context != nullptr) {
+			state.context->examined = std::max(state.context->examined, end);
+		}
+	}
+
+	static void markFailure(const ParserState& state, std::size_t index, std::uint32_t itemId) {
+		if (state.context != nullptr) {
+			state.context->failure.add(index, itemId);
+		}
+	}
+
+	void FurthestFailure::add(std::size_t failedIndex, std::uint32_t itemId) {
+		if (count == 0 || failedIndex > index) {
+			index = failedIndex;
+			count = 0;
+		}
+		else if (failedIndex < index) {
+			return;
+		}
+		const auto items = std::span(expected).first(count);
+		if (count < capacity && std::ranges::find(items, itemId) == items.end()) {
+			expected[count++] = itemId;
+		}
+	}
+
+	std::string FurthestFailure::message() const {
+		if (count == 0) {
+			return {};
+		}
+		std::string items = itemName(expected[0]);
+		for (std::size_t i = 1; i < count; ++i) {
+			items += (i + 1 == count ? " or " : ", ") + itemName(expected[i]);
+		}
+		return std::format("Expected {} at index {}", items, index);
+	}
+
+	// open addressing, a slot is set once and never changes. At most half of the slots are used so
+	// probes stay short and a missing name always reaches an empty slot
+	static constexpr std::size_t itemSlots = 1 << 15;
+	static constexpr std::size_t maxItems = itemSlots / 2;
+	static constexpr std::uint32_t otherItemId = itemSlots;
+	static std::array<std::atomic<const std::string*>, itemSlots> itemNames{};
+	static std::atomic<std::size_t> itemCount{ 0 };
+
+	std::uint32_t FurthestFailure::itemId(std::string_view name) {
+		const auto hash = std::hash<std::string_view>{}(name);
+		for (std::size_t probe = 0; probe < itemSlots; ++probe) {
+			const auto slot = (hash + probe) & (itemSlots - 1);
+			const auto* item = itemNames[slot].load(std::memory_order_acquire);
+			if (item == nullptr) {
+				if (itemCount.fetch_add(1, std::memory_order_relaxed) >= maxItems) {
+					itemCount.fetch_sub(1, std::memory_order_relaxed);
+					return otherItemId;
+				}
+				// the names stay for the lifetime of the process, there are at most maxItems of them
+				auto* created = new std::string(name);
+				if (itemNames[slot].compare_exchange_strong(item, created, std::memory_order_acq_rel)) {
+					return static_cast<std::uint32_t>(slot);
+				}
+				// another thread took the slot, item is its name
+				delete created;
+				itemCount.fetch_sub(1, std::memory_order_relaxed);
+			}
+			if (*item == name) {
+				return static_cast<std::uint32_t>(slot);
+			}
+		}
+		return otherItemId;
+	}
+
+	std::string FurthestFailure::itemName(std::uint32_t itemId) {
+		if (itemId >= itemSlots) {
+			return "other input";
+		}
+		const auto* item = itemNames[itemId].load(std::memory_order_acquire);
+		return item != nullptr ? *item : std::string{};
+	}
+
+	Position LineIndex::position(std::size_t offset) const {
+		if (!built_) {
+			const char* data = text_.data();
+			const std::size_t size = text_.length();
+			std::size_t index = 0;
+#ifdef COMBINATORS_SSE2
+			// 16 bytes per step, one bit per newline
+			const auto newline = _mm_set1_epi8('\n');
+			for (; index + 16 <= size; index += 16) {
+				const auto chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + index));
+				auto mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline)));
+				while (mask != 0) {
+					lineStarts_.push_back(index + std::countr_zero(mask) + 1);
+					mask &= mask - 1;
+				}
+			}
+#endif
+			while (index < size) {
+				const auto* found = static_cast<const char*>(std::memchr(data + index, '\n', size - index));
+				if (found == nullptr) {
+					break;
+				}
+				index = found - data + 1;
+				lineStarts_.push_back(index);
+			}
+			built_ = true;
+		}
+		const auto line = static_cast<std::size_t>(
+			std::upper_bound(lineStarts_.begin(), lineStarts_.end(), offset) - lineStarts_.begin());
+		const auto lineStart = line == 0 ? 0 : lineStarts_[line - 1];
+		return Position{ line + 1, offset - lineStart + 1 };
+	}
+
+	void RunContext::startRun(const std::string_view& input) {
+		examined = 0;
+		lines = LineIndex(input);
+		failure = {};
+		depth = 0;
+		aborted = false;
+		limit = RunLimit::None;
+		steps = 0;
+		nextCheck = 0;
+	}
+
+	ParserState Parser::run(const std::string_view& targetString) const {
+		RunContext context{};
+		return run(targetString, context);
+	}
+
+	ParserState Parser::run(const std::string_view& targetString, RunContext& context) const {
+		context.startRun(targetString);
+		return countRunStats(context, [&]() {
+			ParserState initialState{ targetString, 0, {}, false, {}, &context };
+			if (context.utf8) {
+				if (const auto invalid = validateUtf8(targetString); invalid != targetString.length()) {
+					auto errorState = updateParserError(ParserState{ targetString, invalid, {}, false, {}, &context },
+						std::format("utf8: Invalid UTF-8 at index {}", invalid));
+					errorState.context = nullptr;
+					return errorState;
+				}
+			}
+			auto finalState = transformerFn(initialState);
+			finalState.error = errorMessage(finalState);
+			finalState.context = nullptr;
+			return finalState;
+		});
+	}
+
+	static void appendValues(const ParseResult& result, std::vector<std::string>& values) {
+		std::size_t next = 0;
+		for (auto& part : result.parts) {
+			values.insert(values.end(), result.values.begin() + next, result.values.begin() + part.at);
+			next = part.at;
+			appendValues(*part.result, values);
+		}
+		values.insert(values.end(), result.values.begin() + next, result.values.end());
+	}
+
+	ParseResult ParseResult::flattened() const {
+		if (parts.empty()) {
+			return *this;
+		}
+		ParseResult result;
+		appendValues(*this, result.values);
+		return result;
+	}
+
 	const ParserState updateParserState(const ParserState& state, std::size_t index, const ParseResult& result) {
 		return ParserState{
 			state.targetString,
 			index,
-			result
+			result,
+			false,
+			{},
+			state.context
 		};
 	}
 
@@ -15,73 +192,247 @@ namespace Combinators {
 		return updateParserState(state, state.index, result);
 	}
 
+	const ParserState updateParserMatch(const ParserState& state, std::size_t index, std::string value, std::uint32_t itemId) {
+		if (auto* sink = runSink(state)) {
+			sink->event(SinkEvent{ SinkEvent::Kind::Token, itemId, state.index, index });
+			return updateParserState(state, index, {});
+		}
+		if (skipValues(state)) {
+			return updateParserState(state, index, {});
+		}
+		return updateParserState(state, index, { { std::move(value) } });
+	}
+
+	void endAttempt(const RunContext* context, const OutputMark& mark, bool succeeded) {
+		if (context == nullptr) {
+			return;
+		}
+		if (auto* ast = context->ast; ast != nullptr && !succeeded) {
+			ast->nodes.resize(mark.nodes);
+			ast->roots.resize(mark.roots);
+		}
+		if (auto* sink = context->sink) {
+			--sink->speculation;
+			if (!succeeded) {
+				sink->pending.resize(mark.events);
+			}
+			else if (sink->speculation == 0) {
+				for (auto& event : sink->pending) {
+					sink->callback(event);
+				}
+				// the capacity stays for the next attempts
+				sink->pending.clear();
+			}
+		}
+	}
+
+	// a failure of the parser leaves no Ast nodes or sink events
+	static bool failsWithoutOutput(const Parser& parser) {
+		if (parser.node == nullptr) {
+			return false;
+		}
+		const auto& node = *parser.node;
+		switch (node.kind) {
+		case GrammarNode::Kind::Str:
+		case GrammarNode::Kind::Regexp:
+		case GrammarNode::Kind::Literals:
+		case GrammarNode::Kind::RepeatLiteral:
+		case GrammarNode::Kind::RepeatBytes:
+		case GrammarNode::Kind::Peek:
+		case GrammarNode::Kind::NotFollowedBy:
+		case GrammarNode::Kind::Recognize:
+		case GrammarNode::Kind::Integer:
+		case GrammarNode::Kind::Varint:
+		case GrammarNode::Kind::Take:
+			return true;
+		case GrammarNode::Kind::Choice:
+		case GrammarNode::Kind::AdaptiveChoice:
+			return std::ranges::all_of(node.children, failsWithoutOutput);
+		case GrammarNode::Kind::Map:
+		case GrammarNode::Kind::MapError:
+		case GrammarNode::Kind::Memo:
+		case GrammarNode::Kind::Named:
+			return failsWithoutOutput(node.children[0]);
+		default:
+			return false;
+		}
+	}
+
+	// only an aborted run stops the parser
+	static bool neverFails(const Parser& parser) {
+		if (parser.node == nullptr) {
+			return false;
+		}
+		const auto& node = *parser.node;
+		switch (node.kind) {
+		case GrammarNode::Kind::Star:
+		case GrammarNode::Kind::SepByStar:
+			return true;
+		case GrammarNode::Kind::RepeatLiteral:
+		case GrammarNode::Kind::RepeatBytes:
+			return !node.atLeastOne;
+		case GrammarNode::Kind::Sequence:
+			return std::ranges::all_of(node.children, neverFails);
+		case GrammarNode::Kind::Choice:
+			return std::ranges::any_of(node.children, neverFails);
+		case GrammarNode::Kind::Map:
+		case GrammarNode::Kind::Memo:
+		case GrammarNode::Kind::Named:
+			return neverFails(node.children[0]);
+		default:
+			return false;
+		}
+	}
+
+	bool alternativeAttempt(const std::vector<Parser>& alternatives, std::size_t i) {
+		return i + 1 < alternatives.size() && !neverFails(alternatives[i]) && !failsWithoutOutput(alternatives[i]);
+	}
+
+	bool iterationAttempt(const Parser& parser) {
+		return !failsWithoutOutput(parser) || nullable(parser) != Nullable::No;
+	}
+
 	const ParserState updateParserError(const ParserState& state, const std::string& errorMsg) {
+		if (isRecognizing(state)) {
+			return ParserState{ state.targetString, state.index, {}, true, {}, state.context };
+		}
+		if (auto* stats = runStats(state)) {
+			++stats->errors;
+		}
 		return ParserState{
 			state.targetString,
 			state.index,
 			{},
 			//state.result,
 			true,
-			errorMsg
+			errorMsg,
+			state.context
 		};
 	}
 
+	std::string errorMessage(const ParserState& state) {
+		if (!state.isError || !state.error.empty() || state.context == nullptr) {
+			return state.error;
+		}
+		const auto& failure = state.context->failure;
+		return failure.count != 0 ? failure.message() : std::format("Unable to match at index {}", state.index);
+	}
+
+	const ParserState abortParser(const ParserState& state, const std::string& errorMsg) {
+		if (state.context != nullptr) {
+			state.context->aborted = true;
+		}
+		return updateParserError(state, errorMsg);
+	}
+
+	bool checkLimits(RunContext& context) {
+		if (context.steps > context.maxSteps) {
+			context.limit = RunLimit::Steps;
+		}
+		else if (context.stop.stop_requested()) {
+			context.limit = RunLimit::Cancelled;
+		}
+		else if (context.deadline != std::chrono::steady_clock::time_point::max() && std::chrono::steady_clock::now() >= context.deadline) {
+			context.limit = RunLimit::Deadline;
+		}
+		else {
+			context.nextCheck = context.steps + std::min(RunContext::checkInterval, context.maxSteps - context.steps) + 1;
+			return false;
+		}
+		return true;
+	}
+
+	const ParserState abortAtLimit(const ParserState& state) {
+		switch (state.context->limit) {
+		case RunLimit::Steps:
+			return abortParser(state, std::format("limit: Step limit {} reached at index {}", state.context->maxSteps, state.index));
+		case RunLimit::Deadline:
+			return abortParser(state, std::format("limit: Deadline passed at index {}", state.index));
+		default:
+			return abortParser(state, std::format("limit: Run cancelled at index {}", state.index));
+		}
+	}
+
 	Parser Parsers::str(const std::string& prefix) {
-		auto str = [prefix](const ParserState& state) {
-			const auto [targetString, index, _, isError, __] = state;
+		auto str = [prefix, itemId = FurthestFailure::itemId(std::format("\"{}\"", prefix))](const ParserState& state) {
+			const auto& [targetString, index, _, isError, __, ___] = state;
 			if (isError) {
 				return state;
 			}
+			countInvocation(state);
+			markExamined(state, index + std::max<std::size_t>(prefix.length(), 1));
 			auto slicedTarget = targetString.substr(index);
 			if (slicedTarget.length() == 0) {
 				// error
-				return updateParserError(state,
-					std::format("str: Tried to match \"{}\", but got unexpected end of input.", prefix));
+				markFailure(state, index, itemId);
+				return updateParserFailure(state,
+					"str: Tried to match \"{}\", but got unexpected end of input.", prefix);
 			}
 
 			if (slicedTarget.starts_with(prefix)) {
 				// success
-				return updateParserState(state, index + prefix.length(), { {prefix} });
+				return updateParserMatch(state, index + prefix.length(), prefix, itemId);
 			}
 			// error
-			return updateParserError(state,
-				std::format("str: Tried to match \"{}\", but got \"{}\"",
-					prefix, slicedTarget.substr(0, 10)));
+			markFailure(state, index, itemId);
+			return updateParserFailure(state,
+				"str: Tried to match \"{}\", but got \"{}\"",
+					prefix, slicedTarget.substr(0, 10));
 		};
-		return Parser{ str };
+		return Parser{ str, node(GrammarNode::Kind::Str, {}, prefix) };
 	}
 
-	Parser Parsers::regexp(const std::regex& re, const std::string_view& name) {
-		auto regexp = [re, name](const ParserState& state) {
-			const auto [targetString, index, _, isError, __] = state;
+	Parser Parsers::regexp(const std::regex& re, const std::string_view& name, std::size_t lookahead) {
+		auto regexp = [re, name, lookahead, itemId = FurthestFailure::itemId(std::string(name))](const ParserState& state) {
+			const auto& [targetString, index, _, isError, __, ___] = state;
 			if (isError) {
 				return state;
 			}
+			countInvocation(state);
+			// end of input counts as one more character
+			auto examinedFrom = [&](std::size_t from) {
+				markExamined(state, from + std::min(lookahead, targetString.length() + 1 - from));
+			};
 			auto slicedTarget = targetString.substr(index);
 			if (slicedTarget.length() == 0) {
 				// error
-				return updateParserError(state, std::format("{}: Got unexpected end of input.", name));
+				markExamined(state, index + 1);
+				markFailure(state, index, itemId);
+				return updateParserFailure(state, "{}: Got unexpected end of input.", name);
 			}
 			std::cmatch match;
-			if (std::regex_search(slicedTarget.data(), match, re, std::regex_constants::match_continuous)) {
+			if (std::regex_search(slicedTarget.data(), slicedTarget.data() + slicedTarget.length(),
+				match, re, std::regex_constants::match_continuous)) {
 				// success
-				return updateParserState(state, index + match[0].length(), { {match[0]} });
+				examinedFrom(index + match[0].length());
+				if (skipValues(state)) {
+					return updateParserMatch(state, index + match[0].length(), {}, itemId);
+				}
+				return updateParserMatch(state, index + match[0].length(), match[0], itemId);
 			}
 			// error
-			return updateParserError(state,
-				std::format("{}: Couldn't match {} at index {}", name, name, index));
+			examinedFrom(index);
+			markFailure(state, index, itemId);
+			return updateParserFailure(state,
+				"{}: Couldn't match {} at index {}", name, name, index);
 		};
-		return Parser{ regexp };
+		return Parser{ regexp, node(GrammarNode::Kind::Regexp, {}, std::string(name)) };
+	}
+
+	Parser Parsers::regexp(const std::string& pattern, const std::string_view& name, std::size_t lookahead) {
+		auto parser = regexp(std::regex(pattern), name, lookahead);
+		parser.node = std::make_shared<const GrammarNode>(
+			GrammarNode{ GrammarNode::Kind::Regexp, std::string(name), {}, {}, {}, false, pattern, lookahead });
+		return parser;
 	}
 
 	Parser Parsers::letters() {
-		std::regex letterRegex("[^\\W\\d]+");
-		return Parsers::regexp(letterRegex, "letters");
+		// a character class repetition looks one character past the match
+		return Parsers::regexp(std::string("[^\\W\\d]+"), "letters", 1);
 	}
 
 	Parser Parsers::digits() {
-		std::regex digitsRegex("\\d+");
-		return Parsers::regexp(digitsRegex, "digits");
+		return Parsers::regexp(std::string("\\d+"), "digits", 1);
 	}
 
 	// runtime sequence
@@ -101,75 +452,374 @@ namespace Combinators {
 			}
 			return updateParserResult(nextState, result);
 		};
-		return Parser{ sequenceOf };
+		return optimize(Parser{ sequenceOf, node(GrammarNode::Kind::Sequence, parsers) });
 	}
 
 	// runtime choice
 	Parser Parsers::choice(const std::vector<Parser>& parsers) {
-		auto choice = [parsers](const ParserState& state) {
+		std::vector<bool> attempts;
+		for (std::size_t i = 0; i < parsers.size(); ++i) {
+			attempts.push_back(alternativeAttempt(parsers, i));
+		}
+		auto choice = [parsers, attempts](const ParserState& state) {
 			if (state.isError) {
 				return state;
 			}
-			for (auto& parser : parsers) {
-				const auto nextState = parser.transformerFn(state);
-				if (!nextState.isError) {
+			for (std::size_t i = 0; i < parsers.size(); ++i) {
+				const auto output = attempts[i] ? beginAttempt(state.context) : OutputMark{};
+				const auto nextState = parsers[i].transformerFn(state);
+				if (attempts[i]) {
+					endAttempt(state.context, output, !nextState.isError);
+				}
+				if (!nextState.isError || isAborted(nextState)) {
 					return nextState;
 				}
+				countBacktrack(state);
 			}
-			return updateParserError(state,
-				std::format("choice: Unable to match with any parser at index {}", state.index));
+			return updateParserFailure(state,
+				"choice: Unable to match with any parser at index {}", state.index);
 		};
-		return Parser{ choice };
+		return optimize(Parser{ choice, node(GrammarNode::Kind::Choice, parsers) });
 	}
 
 	Parser Parsers::plus(const Parser& parser) {
-		auto plus = [parser](const ParserState& state) {
+		auto plus = [parser, attempt = iterationAttempt(parser), loopId = MemoTable::newRuleId()](const ParserState& state) {
 			if (state.isError) {
 				return state;
 			}
 			ParseResult result;
 			auto nextState = state;
+			// the parser can match without giving values (astNode, sink mode), so count the matches
+			bool matched = false;
 			bool done = false;
+			LoopChunks chunks(state, loopId);
 			while (!done) {
+				if (countStep(state.context)) {
+					return abortAtLimit(nextState);
+				}
+				if (chunks.hop(nextState, result)) {
+					matched = true;
+					continue;
+				}
+				const auto output = attempt ? beginAttempt(state.context) : OutputMark{};
 				const auto testState = parser.transformerFn(nextState);
-				if (!testState.isError) {
+				// after the first match, one without consuming input would repeat forever, it ends the loop
+				const bool repeated = !testState.isError && (!matched || testState.index != nextState.index);
+				if (attempt) {
+					endAttempt(state.context, output, repeated);
+				}
+				if (repeated) {
 					nextState = testState;
 					result += testState.result;
+					matched = true;
+					chunks.iterated(nextState, result);
 					continue;
 				}
+				if (isAborted(testState)) {
+					return testState;
+				}
 				done = true;
 			}
-			if (result.values.empty()) {
-				return updateParserError(state,
-					std::format("plus: Unable to match any input using parser at index {}", state.index));
+			if (!matched) {
+				return updateParserFailure(state,
+					"plus: Unable to match any input using parser at index {}", state.index);
 			}
 			return updateParserResult(nextState, result);
 		};
-		return Parser{ plus };
+		checkLoop("plus", { parser });
+		return optimize(Parser{ plus, node(GrammarNode::Kind::Plus, { parser }) });
 	}
 
 	Parser Parsers::star(const Parser& parser) {
-		auto star = [parser](const ParserState& state) {
+		auto star = [parser, attempt = iterationAttempt(parser), loopId = MemoTable::newRuleId()](const ParserState& state) {
 			if (state.isError) {
 				return state;
 			}
 			ParseResult result;
 			auto nextState = state;
 			bool done = false;
+			LoopChunks chunks(state, loopId);
 			while (!done) {
+				if (countStep(state.context)) {
+					return abortAtLimit(nextState);
+				}
+				if (chunks.hop(nextState, result)) {
+					continue;
+				}
+				const auto output = attempt ? beginAttempt(state.context) : OutputMark{};
 				const auto testState = parser.transformerFn(nextState);
-				if (!testState.isError) {
+				// a match without consuming input would repeat forever, it ends the loop
+				const bool repeated = !testState.isError && testState.index != nextState.index;
+				if (attempt) {
+					endAttempt(state.context, output, repeated);
+				}
+				if (repeated) {
 					nextState = testState;
 					result += testState.result;
+					chunks.iterated(nextState, result);
 					continue;
 				}
+				if (isAborted(testState)) {
+					return testState;
+				}
 				done = true;
 			}
 			return updateParserResult(nextState, result);
 		};
-		return Parser{ star };
+		checkLoop("star", { parser });
+		return optimize(Parser{ star, node(GrammarNode::Kind::Star, { parser }) });
+	}
+
+
+	void Parsers::checkLoop(const std::string& name, const std::vector<Parser>& body) {
+		if (std::ranges::all_of(body, [](const Parser& parser) { return nullable(parser) == Nullable::Yes; })) {
+			throw std::invalid_argument(std::format("{}: Parser can match without consuming input, the loop would never end", name));
+		}
+	}
+
+	std::shared_ptr<const GrammarNode> Parsers::node(GrammarNode::Kind kind, std::vector<Parser> children, std::string text) {
+		return std::make_shared<const GrammarNode>(GrammarNode{ kind, std::move(text), std::move(children) });
+	}
+
+	static bool isNode(const Parser& parser, GrammarNode::Kind kind) {
+		return parser.node != nullptr && parser.node->kind == kind;
 	}
 
+	// adjacent str parsers in one compare, the original parsers report the errors
+	static Parser literals(const std::vector<Parser>& parsers) {
+		std::string text;
+		ParseResult values;
+		std::vector<std::uint32_t> itemIds;
+		for (auto& parser : parsers) {
+			text += parser.node->text;
+			values += parser.node->text;
+			itemIds.push_back(FurthestFailure::itemId(std::format("\"{}\"", parser.node->text)));
+		}
+		auto literals = [text, values, itemIds, parsers](const ParserState& state) {
+			if (state.isError) {
+				return state;
+			}
+			countInvocation(state);
+			if (state.targetString.substr(state.index).starts_with(text)) {
+				markExamined(state, state.index + text.length());
+				if (auto* sink = runSink(state)) {
+					// the events of the str parsers
+					auto index = state.index;
+					for (std::size_t i = 0; i < itemIds.size(); ++i) {
+						sink->event(SinkEvent{ SinkEvent::Kind::Token, itemIds[i], index, index + values.values[i].length() });
+						index += values.values[i].length();
+					}
+					return updateParserState(state, index, {});
+				}
+				if (skipValues(state)) {
+					return updateParserState(state, state.index + text.length(), {});
+				}
+				return updateParserState(state, state.index + text.length(), values);
+			}
+			// not through sequenceOf, it would merge the parsers again
+			auto nextState = state;
+			for (auto& parser : parsers) {
+				nextState = parser.transformerFn(nextState);
+				if (nextState.isError) {
+					return nextState;
+				}
+			}
+			return nextState;
+		};
+		return Parser{ literals, Parsers::node(GrammarNode::Kind::Literals, parsers, text) };
+	}
+
+	// star/plus over a str parser without a state per repetition
+	static Parser repeatLiteral(const std::string& literal, bool atLeastOne) {
+		auto repeat = [literal, atLeastOne, itemId = FurthestFailure::itemId(std::format("\"{}\"", literal))](const ParserState& state) {
+			if (state.isError) {
+				return state;
+			}
+			countInvocation(state);
+			ParseResult result;
+			auto* sink = runSink(state);
+			const bool recognizing = skipValues(state);
+			auto index = state.index;
+			while (state.targetString.substr(index).starts_with(literal)) {
+				if (sink != nullptr) {
+					sink->event(SinkEvent{ SinkEvent::Kind::Token, itemId, index, index + literal.length() });
+				}
+				else if (!recognizing) {
+					result += literal;
+				}
+				index += literal.length();
+			}
+			// the failed try after the last repetition
+			markExamined(state, index + literal.length());
+			markFailure(state, index, itemId);
+			if (atLeastOne && index == state.index) {
+				return updateParserFailure(state,
+					"plus: Unable to match any input using parser at index {}", state.index);
+			}
+			return updateParserState(state, index, result);
+		};
+		return Parser{ repeat, std::make_shared<const GrammarNode>(GrammarNode{ GrammarNode::Kind::RepeatLiteral, literal, {}, {}, {}, atLeastOne }) };
+	}
+
+	// star/plus over a choice of one character str parsers, a byte table lookup per character
+	static Parser repeatBytes(const std::vector<Parser>& alternatives, bool atLeastOne) {
+		std::array<bool, 256> bytes{};
+		std::vector<std::uint32_t> itemIds;
+		// item of each byte for the sink events
+		std::array<std::uint32_t, 256> byteItemIds{};
+		std::string text;
+		for (auto& alternative : alternatives) {
+			const auto byte = alternative.node->text[0];
+			bytes[static_cast<unsigned char>(byte)] = true;
+			itemIds.push_back(FurthestFailure::itemId(std::format("\"{}\"", byte)));
+			byteItemIds[static_cast<unsigned char>(byte)] = itemIds.back();
+			text += byte;
+		}
+		auto repeat = [bytes, itemIds, byteItemIds, atLeastOne](const ParserState& state) {
+			if (state.isError) {
+				return state;
+			}
+			countInvocation(state);
+			ParseResult result;
+			auto* sink = runSink(state);
+			const bool recognizing = skipValues(state);
+			auto index = state.index;
+			const auto targetString = state.targetString;
+			while (index < targetString.length() && bytes[static_cast<unsigned char>(targetString[index])]) {
+				if (sink != nullptr) {
+					sink->event(SinkEvent{ SinkEvent::Kind::Token, byteItemIds[static_cast<unsigned char>(targetString[index])], index, index + 1 });
+				}
+				else if (!recognizing) {
+					result += std::string(1, targetString[index]);
+				}
+				++index;
+			}
+			// the failed try of every alternative after the last repetition
+			markExamined(state, index + 1);
+			for (auto itemId : itemIds) {
+				markFailure(state, index, itemId);
+			}
+			if (atLeastOne && index == state.index) {
+				return updateParserFailure(state,
+					"plus: Unable to match any input using parser at index {}", state.index);
+			}
+			return updateParserState(state, index, result);
+		};
+		return Parser{ repeat, std::make_shared<const GrammarNode>(GrammarNode{ GrammarNode::Kind::RepeatBytes, text, alternatives, {}, {}, atLeastOne }) };
+	}
+
+	Parser Parsers::optimize(const Parser& parser) {
+		using Kind = GrammarNode::Kind;
+		if (parser.node == nullptr) {
+			return parser;
+		}
+		const auto& node = *parser.node;
+		switch (node.kind) {
+		case Kind::Sequence: {
+			bool changed = false;
+			std::vector<Parser> children;
+			for (auto& child : node.children) {
+				if (isNode(child, Kind::Sequence)) {
+					children.insert(children.end(), child.node->children.begin(), child.node->children.end());
+					changed = true;
+				}
+				else {
+					children.push_back(child);
+				}
+			}
+			std::vector<Parser> merged;
+			for (std::size_t i = 0; i < children.size();) {
+				auto end = i;
+				// merged literals of a nested sequence merge again with the literals around them
+				std::vector<Parser> strs;
+				while (end < children.size()) {
+					const auto& child = children[end];
+					if (isNode(child, Kind::Str) && !child.node->text.empty()) {
+						strs.push_back(child);
+					}
+					else if (isNode(child, Kind::Literals)) {
+						strs.insert(strs.end(), child.node->children.begin(), child.node->children.end());
+					}
+					else {
+						break;
+					}
+					++end;
+				}
+				if (end - i > 1) {
+					merged.push_back(literals(strs));
+					changed = true;
+					i = end;
+				}
+				else {
+					merged.push_back(children[i++]);
+				}
+			}
+			return changed ? sequenceOf(std::as_const(merged)) : parser;
+		}
+		case Kind::Choice: {
+			if (std::ranges::none_of(node.children, [](auto& child) { return isNode(child, Kind::Choice); })) {
+				return parser;
+			}
+			std::vector<Parser> children;
+			for (auto& child : node.children) {
+				if (isNode(child, Kind::Choice)) {
+					children.insert(children.end(), child.node->children.begin(), child.node->children.end());
+				}
+				else {
+					children.push_back(child);
+				}
+			}
+			return choice(std::as_const(children));
+		}
+		case Kind::Star:
+		case Kind::Plus: {
+			const auto& child = node.children[0];
+			const bool atLeastOne = node.kind == Kind::Plus;
+			if (isNode(child, Kind::Str) && !child.node->text.empty()) {
+				return repeatLiteral(child.node->text, atLeastOne);
+			}
+			if (isNode(child, Kind::Choice) && std::ranges::all_of(child.node->children, [](auto& alternative) {
+				return isNode(alternative, Kind::Str) && alternative.node->text.length() == 1;
+				})) {
+				return repeatBytes(child.node->children, atLeastOne);
+			}
+			return parser;
+		}
+		case Kind::Between: {
+			// str and regexp give exactly one value, so the slicing map keeps the content result
+			auto oneValue = [](const Parser& parser) {
+				return isNode(parser, Kind::Str) || isNode(parser, Kind::Regexp);
+			};
+			const auto& left = node.children[0];
+			const auto& content = node.children[1];
+			const auto& right = node.children[2];
+			if (!oneValue(left) || !oneValue(right)) {
+				return parser;
+			}
+			auto between = [left, content, right](const ParserState& state) {
+				if (state.isError) {
+					return state;
+				}
+				const auto leftState = left.transformerFn(state);
+				if (leftState.isError) {
+					return leftState;
+				}
+				const auto contentState = content.transformerFn(leftState);
+				if (contentState.isError) {
+					return contentState;
+				}
+				const auto rightState = right.transformerFn(contentState);
+				if (rightState.isError) {
+					return rightState;
+				}
+				return updateParserResult(rightState, contentState.result);
+			};
+			return Parser{ between, parser.node };
+		}
+		default:
+			return parser;
+		}
+	}
 
 	Parser Parsers::betweenBrackets(const Parser& contentParser) {
 		auto betweenBrackets = Parsers::between(str("("), str(")"));
@@ -181,13 +831,322 @@ namespace Combinators {
 			if (state.isError) {
 				return state;
 			}
+			countInvocation(state);
+			if (countStep(state.context)) {
+				return abortAtLimit(state);
+			}
 			auto parser = fn();
-			return parser.transformerFn(state);
+			auto* context = state.context;
+			if (context == nullptr) {
+				return parser.transformerFn(state);
+			}
+			if (context->depth >= context->maxDepth) {
+				return abortParser(state,
+					std::format("lazy: Maximum nesting depth {} reached at index {}", context->maxDepth, state.index));
+			}
+			++context->depth;
+			if (context->stats != nullptr) {
+				context->stats->maxDepth = std::max<std::uint64_t>(context->stats->maxDepth, context->depth);
+			}
+			const auto nextState = parser.transformerFn(state);
+			--context->depth;
+			return nextState;
 		};
-		return Parser{ lazy };
+		return Parser{ lazy, std::make_shared<const GrammarNode>(GrammarNode{ GrammarNode::Kind::Lazy, {}, {}, fn }) };
 	}
 
 
+	// the expected items of a rule run at offset, its index from the offset
+	static void addFailure(FurthestFailure& failure, const FurthestFailure& rule, std::size_t offset) {
+		for (auto itemId : std::span(rule.expected).first(rule.count)) {
+			failure.add(rule.index + offset, itemId);
+		}
+	}
+
+	// the result as one shared part, a memo hit gives it by reference
+	static void shareResult(ParseResult& result) {
+		if (result.values.empty() && (result.parts.empty() || (result.parts.size() == 1 && result.parts[0].at == 0))) {
+			return;
+		}
+		auto shared = std::make_shared<const ParseResult>(std::move(result));
+		result = ParseResult{ {}, { ParseResult::Part{ std::move(shared), 0 } } };
+	}
+
+	std::size_t MemoTable::newRuleId() {
+		static std::atomic<std::size_t> nextRuleId = 0;
+		return nextRuleId++;
+	}
+
+	LoopChunks::LoopChunks(const ParserState& state, std::size_t loopId) : loopId_(loopId) {
+		auto* context = state.context;
+		// like memo results the chunks don't have the Ast nodes and sink events of their iterations
+		if (context != nullptr && context->shareResults && context->memo != nullptr && context->ast == nullptr && context->sink == nullptr) {
+			context_ = context;
+			begin(state.index, {});
+		}
+	}
+
+	LoopChunks::~LoopChunks() {
+		if (context_ != nullptr) {
+			end();
+		}
+	}
+
+	void LoopChunks::begin(std::size_t index, const ParseResult& result) {
+		start_ = index;
+		iterations_ = 0;
+		valuesFrom_ = result.values.size();
+		partsFrom_ = result.parts.size();
+		outerExamined_ = context_->examined;
+		context_->examined = index;
+		outerFailure_ = std::exchange(context_->failure, FurthestFailure{});
+	}
+
+	FurthestFailure LoopChunks::end() {
+		auto failure = std::exchange(context_->failure, outerFailure_);
+		addFailure(context_->failure, failure, 0);
+		context_->examined = std::max(outerExamined_, context_->examined);
+		return failure;
+	}
+
+	bool LoopChunks::hop(ParserState& state, ParseResult& result) {
+		if (context_ == nullptr) {
+			return false;
+		}
+		const auto* entry = context_->memo->find(state.index, loopId_);
+		if (entry == nullptr || (!context_->recognizing && entry->recognized)) {
+			return false;
+		}
+		// the iterations since the last chunk stay in the result of the loop as they are
+		end();
+		context_->examined = std::max(context_->examined, state.index + entry->examined);
+		addFailure(context_->failure, entry->failure, state.index);
+		result += entry->result;
+		state.index += entry->length;
+		begin(state.index, result);
+		return true;
+	}
+
+	void LoopChunks::iterated(const ParserState& state, ParseResult& result) {
+		if (context_ == nullptr || ++iterations_ < chunkIterations) {
+			return;
+		}
+		const auto examined = std::max(context_->examined, state.index);
+		auto failure = end();
+		if (failure.count != 0) {
+			failure.index -= start_;
+		}
+		// the values of the chunk move to one part shared with the entry
+		auto chunk = std::make_shared<ParseResult>();
+		chunk->values.assign(std::make_move_iterator(result.values.begin() + valuesFrom_), std::make_move_iterator(result.values.end()));
+		for (auto part = result.parts.begin() + partsFrom_; part != result.parts.end(); ++part) {
+			chunk->parts.push_back(ParseResult::Part{ std::move(part->result), part->at - valuesFrom_ });
+		}
+		result.values.resize(valuesFrom_);
+		result.parts.resize(partsFrom_);
+		result.parts.push_back(ParseResult::Part{ chunk, valuesFrom_ });
+		context_->memo->store(start_, loopId_, MemoTable::Entry{ state.index - start_, ParseResult{ {}, { ParseResult::Part{ chunk, 0 } } },
+			false, {}, examined - start_, start_, context_->recognizing, failure });
+		begin(state.index, result);
+	}
+
+	Parser Parsers::memo(const Parser& parser) {
+		auto memo = [parser, ruleId = MemoTable::newRuleId()](const ParserState& state) {
+			if (state.isError) {
+				return state;
+			}
+			auto* context = state.context;
+			// remembered results don't have the Ast nodes and sink events of the rule
+			if (context == nullptr || context->memo == nullptr || context->ast != nullptr || context->sink != nullptr) {
+				return parser.transformerFn(state);
+			}
+			const auto* entry = context->memo->find(state.index, ruleId);
+			if (entry != nullptr && (context->recognizing || !entry->recognized)) {
+				context->examined = std::max(context->examined, state.index + entry->examined);
+				addFailure(context->failure, entry->failure, state.index);
+				if (context->recognizing) {
+					return ParserState{ state.targetString, state.index + entry->length, {}, entry->isError, {}, context };
+				}
+				return ParserState{ state.targetString, state.index + entry->length, entry->result, entry->isError, entry->error, context };
+			}
+			const auto outerExamined = context->examined;
+			context->examined = state.index;
+			// the failure of the rule alone, for the entry
+			auto failure = std::exchange(context->failure, FurthestFailure{});
+			auto nextState = parser.transformerFn(state);
+			std::swap(failure, context->failure);
+			addFailure(context->failure, failure, 0);
+			if (isAborted(nextState)) {
+				return nextState;
+			}
+			const auto examined = std::max(context->examined, nextState.index);
+			if (failure.count != 0) {
+				failure.index -= state.index;
+			}
+			if (context->shareResults) {
+				shareResult(nextState.result);
+			}
+			// results of recognition mode have no values and messages, a run which wants them parses again
+			context->memo->store(state.index, ruleId, MemoTable::Entry{ nextState.index - state.index, nextState.result,
+				nextState.isError, nextState.error, examined - state.index, state.index, context->recognizing, failure });
+			context->examined = std::max(outerExamined, examined);
+			return nextState;
+		};
+		return Parser{ memo, node(GrammarNode::Kind::Memo, { parser }) };
+	}
+
+	std::size_t MemoTable::blockOf(std::size_t index) const {
+		const auto next = std::upper_bound(blocks_.begin() + 1, blocks_.end(), index,
+			[](std::size_t index, const Block& block) { return index < block.start; });
+		return static_cast<std::size_t>(next - blocks_.begin()) - 1;
+	}
+
+	const MemoTable::Entry* MemoTable::find(std::size_t index, std::size_t ruleId) const {
+		const auto& block = blocks_[blockOf(index)];
+		const auto found = block.entries.find({ static_cast<std::ptrdiff_t>(index) - block.shift, ruleId });
+		if (found == block.entries.end()) {
+			return nullptr;
+		}
+		return !found->second.isError || found->second.parsedAt == index ? &found->second : nullptr;
+	}
+
+	void MemoTable::store(std::size_t index, std::size_t ruleId, Entry entry) {
+		const auto blockIndex = blockOf(index);
+		auto& block = blocks_[blockIndex];
+		const auto key = static_cast<std::ptrdiff_t>(index) - block.shift;
+		block.end = std::max(block.end, key + static_cast<std::ptrdiff_t>(entry.examined));
+		block.entries.insert_or_assign({ key, ruleId }, std::move(entry));
+		if (block.entries.size() > maxBlockEntries) {
+			split(blockIndex);
+		}
+	}
+
+	void MemoTable::split(std::size_t blockIndex) {
+		auto& block = blocks_[blockIndex];
+		std::vector<std::ptrdiff_t> offsets;
+		offsets.reserve(block.entries.size());
+		for (auto& [key, entry] : block.entries) {
+			offsets.push_back(key.first);
+		}
+		const auto middle = offsets.begin() + offsets.size() / 2;
+		std::ranges::nth_element(offsets, middle);
+		// the results of one offset stay in one block
+		if (*middle == *std::ranges::min_element(offsets)) {
+			return;
+		}
+		Block upper{ static_cast<std::size_t>(*middle + block.shift), block.shift };
+		block.end = 0;
+		for (auto it = block.entries.begin(); it != block.entries.end();) {
+			const auto end = it->first.first + static_cast<std::ptrdiff_t>(it->second.examined);
+			if (it->first.first < *middle) {
+				block.end = std::max(block.end, end);
+				++it;
+				continue;
+			}
+			upper.end = std::max(upper.end, end);
+			upper.entries.insert(block.entries.extract(it++));
+		}
+		blocks_.insert(blocks_.begin() + blockIndex + 1, std::move(upper));
+	}
+
+	void MemoTable::edit(std::size_t offset, std::size_t removed, std::size_t inserted) {
+		const auto delta = static_cast<std::ptrdiff_t>(inserted) - static_cast<std::ptrdiff_t>(removed);
+		const auto removedEnd = offset + removed;
+		for (std::size_t i = 0; i < blocks_.size(); ++i) {
+			auto& block = blocks_[i];
+			if (i != 0 && block.start >= removedEnd) {
+				// all of its results are after the edit
+				block.start = static_cast<std::size_t>(static_cast<std::ptrdiff_t>(block.start) + delta);
+				block.shift += delta;
+				continue;
+			}
+			const auto nextStart = i + 1 < blocks_.size() ? blocks_[i + 1].start : std::numeric_limits<std::size_t>::max();
+			const auto editKey = static_cast<std::ptrdiff_t>(offset) - block.shift;
+			if (nextStart <= offset && block.end <= editKey) {
+				// its results are before the edit and don't look into it
+				continue;
+			}
+			auto& entries = block.entries;
+			const auto removedEndKey = static_cast<std::ptrdiff_t>(removedEnd) - block.shift;
+			// results after the edited range keep their offset plus delta, the ones starting in it are dropped
+			// and so are the ones before it which looked into it
+			std::vector<decltype(block.entries)::node_type> shifted;
+			block.end = 0;
+			for (auto it = entries.begin(); it != entries.end();) {
+				const auto end = it->first.first + static_cast<std::ptrdiff_t>(it->second.examined);
+				if (it->first.first >= removedEndKey) {
+					shifted.push_back(entries.extract(it++));
+				} else if (it->first.first >= editKey || end > editKey) {
+					it = entries.erase(it);
+				} else {
+					block.end = std::max(block.end, end);
+					++it;
+				}
+			}
+			for (auto& node : shifted) {
+				node.key().first += delta;
+				block.end = std::max(block.end, node.key().first + static_cast<std::ptrdiff_t>(node.mapped().examined));
+				entries.insert(std::move(node));
+			}
+			if (i != 0 && block.start > offset) {
+				block.start = offset + inserted;
+			}
+		}
+		// a block without results leaves its offsets to the one before it
+		blocks_.erase(std::remove_if(blocks_.begin() + 1, blocks_.end(), [](const Block& block) { return block.entries.empty(); }), blocks_.end());
+	}
+
+	std::size_t MemoTable::size() const {
+		std::size_t size = 0;
+		for (auto& block : blocks_) {
+			size += block.entries.size();
+		}
+		return size;
+	}
+
+	std::vector<std::uint32_t> Ast::children(std::uint32_t node) const {
+		std::vector<std::uint32_t> children;
+		for (auto child = nodes[node].firstChild; child != AstNode::none; child = nodes[child].nextSibling) {
+			children.push_back(child);
+		}
+		return children;
+	}
+
+	Parser Parsers::astNode(std::uint32_t kind, const Parser& parser) {
+		auto astNode = [kind, parser](const ParserState& state) {
+			if (state.isError) {
+				return state;
+			}
+			auto* ast = state.context != nullptr ? state.context->ast : nullptr;
+			if (ast == nullptr) {
+				return parser.transformerFn(state);
+			}
+			const auto firstRoot = ast->roots.size();
+			const auto nextState = parser.transformerFn(state);
+			if (nextState.isError) {
+				return nextState;
+			}
+			// the nodes added by the parser are still roots, in input order
+			AstNode node{ kind, state.index, nextState.index };
+			if (firstRoot < ast->roots.size()) {
+				node.firstChild = ast->roots[firstRoot];
+				for (auto i = firstRoot; i + 1 < ast->roots.size(); ++i) {
+					ast->nodes[ast->roots[i]].nextSibling = ast->roots[i + 1];
+				}
+			}
+			ast->roots.resize(firstRoot);
+			ast->roots.push_back(static_cast<std::uint32_t>(ast->nodes.size()));
+			ast->nodes.push_back(node);
+			return updateParserResult(nextState, {});
+		};
+		// Program runs it as an escape
+		return Parser{ astNode, node(GrammarNode::Kind::AstNode, { parser }) };
+	}
+
+	Parser Parsers::named(const std::string& name, const Parser& parser) {
+		return Parser{ parser.transformerFn, node(GrammarNode::Kind::Named, { parser }, name) };
+	}
+
 	Parser Parsers::fail(const std::string& error) {
 		auto err = [error](const ParserState& state) {
 			// always return error
@@ -204,4 +1163,5 @@ namespace Combinators {
 		return Parser{ succeed };
 	}
 
-}
\ No newline at end of file
+}
+
@@ -1,6 +1,7 @@
 ﻿#pragma once
 #include <iostream>
 #include <string>
+#include <format>
 #include <vector>
 #include <ranges>
 #include <algorithm>
@@ -9,16 +10,258 @@
 #include <coroutine>
 #include <cassert>
 #include <memory>
+#include <map>
+#include <unordered_map>
+#include <set>
+#include <tuple>
+#include <array>
+#include <cstdint>
+#include <limits>
 #include <utility>
+#include <chrono>
+#include <stop_token>
+#include <bit>
 
 namespace Combinators {
+	struct TokenStream;
+	class MemoTable;
+	class TraceBuffer;
+	class ChoiceProfile;
+
+	struct Position
+	{
+		// both start from 1, column counts bytes
+		std::size_t line = 1;
+		std::size_t column = 1;
+		bool operator==(const Position&) const = default;
+	};
+
+	// offset -> line/column, the newline table is built on the first lookup
+	class LineIndex
+	{
+	public:
+		LineIndex() = default;
+		explicit LineIndex(std::string_view text) : text_(text) {}
+
+		Position position(std::size_t offset) const;
+
+	private:
+		std::string_view text_;
+		mutable bool built_ = false;
+		// offsets of the first character of every line after the first one
+		mutable std::vector<std::size_t> lineStarts_;
+	};
+
+	// offset of the first byte which doesn't start a well-formed UTF-8 sequence, text.length() for valid text
+	std::size_t validateUtf8(const std::string_view& text);
+
+	// what the parsers expected at the furthest failed offset of a run
+	struct FurthestFailure
+	{
+		static constexpr std::size_t capacity = 8;
+
+		std::size_t index = 0;
+		std::size_t count = 0;
+		std::array<std::uint32_t, capacity> expected{};
+
+		void add(std::size_t index, std::uint32_t itemId);
+		// "Expected X, Y or Z at index N", empty without failures
+		std::string message() const;
+
+		// ids of expected items (str literals, regexp and token names), interned when the parser is built
+		// in a bounded lock-free table. Names past its capacity share the item "other input"
+		static std::uint32_t itemId(std::string_view name);
+		static std::string itemName(std::uint32_t itemId);
+	};
+
+	// costs of runs with RunContext::stats
+	struct RunStats
+	{
+		std::uint64_t runs = 0;
+		// primitive parsers (str, regexp, token, ...), lazy rules and machine literals called
+		std::uint64_t invocations = 0;
+		// failed choice alternatives, the next one tries the same input again (failed choice entries of Program)
+		std::uint64_t backtracks = 0;
+		// deepest nesting of lazy and chain parsers (stack of the machine for Program)
+		std::uint64_t maxDepth = 0;
+		// furthest input looked at (end of input counts as one more character) and the input consumed,
+		// tokens for token runs
+		std::uint64_t examined = 0;
+		std::uint64_t consumed = 0;
+		// heap use, only counted when built with COMBINATORS_COUNT_ALLOCATIONS (replaces the global operator new)
+		std::uint64_t allocations = 0;
+		std::uint64_t allocatedBytes = 0;
+		// error messages built (formatted) by failing parsers
+		std::uint64_t errors = 0;
+
+		// sums, the larger maxDepth
+		RunStats& operator+=(const RunStats& stats);
+		bool operator==(const RunStats&) const = default;
+
+		// all runs with stats of the process
+		static RunStats total();
+		// total() in the Prometheus text format
+		static std::string exportTotal();
+		static void addToTotal(const RunStats& stats);
+	};
+
+	// node of Ast, children are linked through nextSibling and come before their parent in Ast::nodes
+	struct AstNode
+	{
+		static constexpr std::uint32_t none = std::numeric_limits<std::uint32_t>::max();
+
+		// given to Parsers::astNode
+		std::uint32_t kind = 0;
+		// input span, token indices for token runs
+		std::size_t begin = 0;
+		std::size_t end = 0;
+		std::uint32_t firstChild = none;
+		std::uint32_t nextSibling = none;
+
+		std::string_view text(std::string_view input) const {
+			return input.substr(begin, end - begin);
+		}
+		bool operator==(const AstNode&) const = default;
+	};
+
+	// tree of the Parsers::astNode rules of a run, all nodes in one array
+	struct Ast
+	{
+		std::vector<AstNode> nodes;
+		// nodes without a parent yet, the top level nodes after the run
+		std::vector<std::uint32_t> roots;
+
+		std::vector<std::uint32_t> children(std::uint32_t node) const;
+	};
+
+	// event of a run in sink mode
+	struct SinkEvent
+	{
+		enum class Kind {
+			// a primitive parser (str, regexp, token, ...) matched
+			Token,
+			// a Parsers::traced rule started and returned
+			Enter,
+			Exit
+		};
+
+		Kind kind;
+		// str literal, regexp or token name of a Token, rule name of Enter and Exit (see FurthestFailure::itemName)
+		std::uint32_t itemId = 0;
+		// input span, token indices for token runs
+		std::size_t begin = 0;
+		std::size_t end = 0;
+		// false for the Exit of a failed rule
+		bool success = true;
+		bool operator==(const SinkEvent&) const = default;
+	};
+
+	// Receiver of the events of a run with RunContext::sink, the parsers give no result values then.
+	// Events of attempts which can still fail (choice alternatives, loop iterations) wait in pending
+	// and reach the callback when the attempt succeeds outside of other attempts. Attempts which can't
+	// undo anything aren't opened (see alternativeAttempt), the others hold their events: a choice
+	// alternative which can fail after a long match keeps the whole match in pending, and so do the
+	// choices and loops of Program.
+	struct ParseSink
+	{
+		std::function<void(const SinkEvent& event)> callback;
+		std::vector<SinkEvent> pending{};
+		// open attempts
+		std::size_t speculation = 0;
+
+		void event(const SinkEvent& event) {
+			if (speculation == 0) {
+				callback(event);
+			}
+			else {
+				pending.push_back(event);
+			}
+		}
+	};
+
+	// limit of RunContext which ended a run
+	enum class RunLimit {
+		None,
+		// RunContext::maxSteps
+		Steps,
+		Deadline,
+		// RunContext::stop was requested
+		Cancelled
+	};
+
+	// per-run scratch shared by all parsers of one run() call
+	struct RunContext
+	{
+		// token stream of the run, when the parser runs over tokens instead of characters
+		const TokenStream* tokens = nullptr;
+		// results of Parsers::memo rules, can outlive the run (see IncrementalParser)
+		MemoTable* memo = nullptr;
+		// memo hits give their results by reference (ParseResult::parts) instead of copies and loops remember runs
+		// of iterations in memo (see LoopChunks), for IncrementalParser; map and chain get the values flattened
+		bool shareResults = false;
+		// end of the input looked at by the current memo rule (end of input counts as one more character)
+		std::size_t examined = 0;
+		// positions of the run input
+		LineIndex lines{};
+		// diagnostics without re-running the parse
+		FurthestFailure failure{};
+		// nesting of lazy and chain parsers, deeper runs stop with an error instead of a stack overflow. A level takes
+		// a few KB of stack (about 1.6 KB for a JSON-like grammar in an optimized build, twice that unoptimized), the
+		// default fits threads with 1 MB stacks; Program runs its rules on a heap stack without this limit
+		std::size_t depth = 0;
+		std::size_t maxDepth = 256;
+		// set by an error which ends the whole run, choice and loops don't try other alternatives
+		bool aborted = false;
+		// UTF-8 input mode, run() fails on input which isn't valid UTF-8 before parsing it
+		bool utf8 = false;
+		// costs of the run are added here and to RunStats::total(), nothing is counted without it
+		RunStats* stats = nullptr;
+		// calls of Parsers::traced rules are recorded here (see Trace.h)
+		TraceBuffer* trace = nullptr;
+		// AST builder mode, Parsers::astNode rules add nodes here instead of returning their values
+		Ast* ast = nullptr;
+		// sink mode, matches are reported here instead of being returned as values;
+		// map is skipped and contextual callbacks get empty results, the parser of chain runs without the sink
+		ParseSink* sink = nullptr;
+		// recognition mode of Parsers::peek, notFollowedBy and recognize, for a whole run which only checks the input:
+		// the parsers give no values and failed ones no error messages (aborted errors keep theirs), map and mapError
+		// are skipped; chain callbacks still get the values of their parser. Its memo entries serve recognition mode only
+		bool recognizing = false;
+		// budget of the run, counted in steps (lazy and chain calls, loop iterations; choice and call instructions of
+		// Program) with the deadline and stop looked at every checkInterval steps. The run ends with an aborted
+		// "limit: ..." error at the index it got to, limit tells which one. Regex backtracking isn't interrupted.
+		std::uint64_t maxSteps = std::numeric_limits<std::uint64_t>::max();
+		std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+		std::stop_token stop{};
+		RunLimit limit = RunLimit::None;
+		std::uint64_t steps = 0;
+		// steps count of the next check
+		std::uint64_t nextCheck = 0;
+		static constexpr std::uint64_t checkInterval = 1024;
+
+		// clears what the previous run left (failure, depth, abort, steps, ...) for a run of the input,
+		// the settings and the tables of the caller stay
+		void startRun(const std::string_view& input);
+	};
+
 	struct ParseResult
 	{
 
 		//std::vector<std::string_view> values;
 		std::vector<std::string> values; // because the map function
+		// remembered results spliced by reference in runs with RunContext::shareResults, the values of a part come
+		// before values[at]; flattened() gives all the values in one vector
+		struct Part
+		{
+			std::shared_ptr<const ParseResult> result;
+			std::size_t at = 0;
+		};
+		std::vector<Part> parts{};
 
 		ParseResult& operator += (const ParseResult& result) {
+			for (auto& part : result.parts) {
+				parts.push_back(Part{ part.result, values.size() + part.at });
+			}
 			values.insert(end(values), std::begin(result.values), std::end(result.values));
 			return *this;
 		}
@@ -28,7 +271,14 @@ namespace Combinators {
 			return *this;
 		}
 
-		bool operator==(const ParseResult&) const = default;
+		ParseResult flattened() const;
+
+		bool operator==(const ParseResult& other) const {
+			if (parts.empty() && other.parts.empty()) {
+				return values == other.values;
+			}
+			return flattened().values == other.flattened().values;
+		}
 	};
 
 	struct ParserState
@@ -39,50 +289,391 @@ namespace Combinators {
 		// error stuff
 		bool isError = false;
 		std::string error{};
+		// run context, reset to nullptr in the state returned by run()
+		RunContext* context = nullptr;
 		bool operator==(const ParserState&) const = default;
 
 	};
 
+	// Results of memo rules by (input offset, rule id) in blocks of neighbouring offsets. A block keeps its results by
+	// their offset minus the shift of the block, so an edit shifts the blocks after it without touching their results.
+	// It re-keys the results after it in its own block and drops the ones depending on the edited range, looking into
+	// the blocks whose results reach it only: the cost of an edit doesn't depend on the distance to the previous one.
+	class MemoTable
+	{
+	public:
+		struct Entry
+		{
+			// input matched and looked at from the offset of the result (end of input counts as one more character)
+			std::size_t length = 0;
+			ParseResult result{};
+			bool isError = false;
+			std::string error{};
+			std::size_t examined = 0;
+			// offset the error message names, a shifted error is parsed again
+			std::size_t parsedAt = 0;
+			// stored in recognition mode, without values and messages for the runs which want them
+			bool recognized = false;
+			// what the rule expected at its furthest failure, the index from the offset of the result.
+			// A hit adds it to the failure of the run
+			FurthestFailure failure{};
+		};
+
+		// id of the entries of a new rule
+		static std::size_t newRuleId();
+		// result of the rule at the offset, nullptr without one
+		const Entry* find(std::size_t index, std::size_t ruleId) const;
+		void store(std::size_t index, std::size_t ruleId, Entry entry);
+		// keep the results which don't depend on the edited range and shift the ones after it
+		void edit(std::size_t offset, std::size_t removed, std::size_t inserted);
+
+		std::size_t size() const;
+
+	private:
+		// a fuller block is split in two
+		static constexpr std::size_t maxBlockEntries = 1024;
+
+		// offset minus shift, rule id
+		using Key = std::pair<std::ptrdiff_t, std::size_t>;
+		struct KeyHash
+		{
+			std::size_t operator()(const Key& key) const {
+				return static_cast<std::size_t>(key.first) * 0x9e3779b97f4a7c15ull ^ key.second;
+			}
+		};
+
+		struct Block
+		{
+			// first offset of the block, it holds the results up to the start of the next one
+			std::size_t start = 0;
+			std::ptrdiff_t shift = 0;
+			// furthest end of the examined input of the results minus shift, an edit before it can reach them
+			std::ptrdiff_t end = 0;
+			// a lookup is a hash probe, an edit goes through the entries of the blocks it reaches anyway
+			std::unordered_map<Key, Entry, KeyHash> entries{};
+		};
+
+		std::size_t blockOf(std::size_t index) const;
+		void split(std::size_t block);
+
+		// the first block starts at 0
+		std::vector<Block> blocks_{ Block{} };
+	};
+
 	const ParserState updateParserState(const ParserState& state, std::size_t index, const ParseResult& result);
+	// error which ends the run (see RunContext::aborted)
+	const ParserState abortParser(const ParserState& state, const std::string& errorMsg);
+
+	inline bool isAborted(const ParserState& state) {
+		return state.isError && state.context != nullptr && state.context->aborted;
+	}
+
+	// sets RunContext::limit when one is reached, true then
+	bool checkLimits(RunContext& context);
+	// counts a step of the run, true when a limit is reached
+	inline bool countStep(RunContext* context) {
+		return context != nullptr && ++context->steps >= context->nextCheck && checkLimits(*context);
+	}
+	// aborted error of the reached limit at the index of the state
+	const ParserState abortAtLimit(const ParserState& state);
+
+	inline RunStats* runStats(const ParserState& state) {
+		return state.context != nullptr ? state.context->stats : nullptr;
+	}
+
+	inline void countInvocation(const ParserState& state) {
+		if (auto* stats = runStats(state)) {
+			++stats->invocations;
+		}
+	}
+
+	inline void countBacktrack(const ParserState& state) {
+		if (auto* stats = runStats(state)) {
+			++stats->backtracks;
+		}
+	}
+
+	inline ParseSink* runSink(const ParserState& state) {
+		return state.context != nullptr ? state.context->sink : nullptr;
+	}
+
+	// sink and recognition mode, a parser building its value can skip it
+	inline bool skipValues(const ParserState& state) {
+		return state.context != nullptr && (state.context->sink != nullptr || state.context->recognizing);
+	}
+
+	inline bool isRecognizing(const ParserState& state) {
+		return state.context != nullptr && state.context->recognizing && !state.context->aborted;
+	}
+
+	// output of a run besides the results (RunContext::ast and sink)
+	struct OutputMark
+	{
+		std::size_t nodes = 0;
+		std::size_t roots = 0;
+		std::size_t events = 0;
+	};
+
+	// choice alternatives and loop iterations are attempts, the output of a failed one is dropped again.
+	// Every beginAttempt has an endAttempt
+	inline OutputMark beginAttempt(const RunContext* context) {
+		if (context == nullptr) {
+			return {};
+		}
+		OutputMark mark;
+		if (auto* ast = context->ast) {
+			mark.nodes = ast->nodes.size();
+			mark.roots = ast->roots.size();
+		}
+		if (auto* sink = context->sink) {
+			mark.events = sink->pending.size();
+			++sink->speculation;
+		}
+		return mark;
+	}
+
+	void endAttempt(const RunContext* context, const OutputMark& mark, bool succeeded);
+
+	// heap allocations and bytes of the current thread (parallel workers add theirs to the run), zeros without
+	// COMBINATORS_COUNT_ALLOCATIONS
+	std::pair<std::uint64_t, std::uint64_t> allocationCounters();
+
+	// runs run() with its own RunStats when the context has stats, adds them to the context and the process total
+	template<typename Run>
+	auto countRunStats(RunContext& context, Run&& run) {
+		auto* outerStats = context.stats;
+		if (outerStats == nullptr) {
+			return run();
+		}
+		RunStats stats{ .runs = 1 };
+		context.stats = &stats;
+		const auto [allocations, allocatedBytes] = allocationCounters();
+		auto state = run();
+		const auto [allocationsAfter, allocatedBytesAfter] = allocationCounters();
+		context.stats = outerStats;
+		stats.allocations += allocationsAfter - allocations;
+		stats.allocatedBytes += allocatedBytesAfter - allocatedBytes;
+		stats.examined = context.examined;
+		stats.consumed = state.index;
+		*outerStats += stats;
+		RunStats::addToTotal(stats);
+		return state;
+	}
 	const ParserState updateParserResult(const ParserState& state, const ParseResult& result);
+	// success of a primitive parser matching up to index with one value, a token event in sink mode,
+	// no value in recognition mode
+	const ParserState updateParserMatch(const ParserState& state, std::size_t index, std::string value, std::uint32_t itemId);
 	const ParserState updateParserError(const ParserState& state, const std::string& errorMsg);
+	// the message is formatted outside of recognition mode only
+	template<typename Arg, typename ... Args>
+	const ParserState updateParserError(const ParserState& state, std::format_string<Arg, Args...> format, Arg&& arg, Args&& ... args) {
+		if (isRecognizing(state)) {
+			return ParserState{ state.targetString, state.index, {}, true, {}, state.context };
+		}
+		return updateParserError(state, std::format(format, std::forward<Arg>(arg), std::forward<Args>(args)...));
+	}
+	// failure whose expected items are in RunContext::failure: in a run the message is left empty and
+	// formatted once by errorMessage when the run fails, without a context it is formatted here
+	template<typename Arg, typename ... Args>
+	const ParserState updateParserFailure(const ParserState& state, std::format_string<Arg, Args...> format, Arg&& arg, Args&& ... args) {
+		if (state.context != nullptr) {
+			return updateParserError(state, std::string{});
+		}
+		return updateParserError(state, std::format(format, std::forward<Arg>(arg), std::forward<Args>(args)...));
+	}
+	// the error of a failed state, "Expected X or Y at index N" from the furthest failure of the run
+	// for a failure which left its message empty
+	std::string errorMessage(const ParserState& state);
+
+	// Iterations of a loop (sepBy, star, plus) remembered in RunContext::memo in runs with RunContext::shareResults:
+	// chunkIterations iterations in a row are one entry found by the offset of the first one, so the parse after
+	// an edit hops over the unchanged iterations of a long list in a few lookups. The result of a chunk is shared
+	// by the entry and the result of the loop
+	class LoopChunks
+	{
+	public:
+		static constexpr std::size_t chunkIterations = 64;
+
+		LoopChunks(const ParserState& state, std::size_t loopId);
+		~LoopChunks();
+		LoopChunks(const LoopChunks&) = delete;
+		LoopChunks& operator=(const LoopChunks&) = delete;
+
+		// before an iteration: a remembered chunk at the index of state moves state and result past it
+		bool hop(ParserState& state, ParseResult& result);
+		// after an iteration which continues the loop, at the index of state
+		void iterated(const ParserState& state, ParseResult& result);
+
+	private:
+		void begin(std::size_t index, const ParseResult& result);
+		// the examined input and failure of the chunk join the ones around it, the failure is returned
+		FurthestFailure end();
+
+		RunContext* context_ = nullptr;
+		std::size_t loopId_ = 0;
+		// offset, iterations and first value and part in the result of the loop of the chunk being parsed
+		std::size_t start_ = 0;
+		std::size_t iterations_ = 0;
+		std::size_t valuesFrom_ = 0;
+		std::size_t partsFrom_ = 0;
+		std::size_t outerExamined_ = 0;
+		FurthestFailure outerFailure_{};
+	};
+
+
+	struct Parser;
 
+	// see Parsers::parallel
+	struct ParallelOptions
+	{
+		// worker threads, 0 - std::thread::hardware_concurrency()
+		std::size_t threads = 0;
+		// smaller lists are parsed sequentially
+		std::size_t minElements = 256;
+		std::size_t minBytes = 1 << 16;
+	};
+	template<typename T>
+	struct Task;
+
+	// inspectable structure of the parsers built by Parsers
+	struct GrammarNode
+	{
+		enum class Kind {
+			Str,
+			Regexp,
+			Sequence,
+			Choice,
+			Star,
+			Plus,
+			Between,
+			SepByStar,
+			SepByPlus,
+			Lazy,
+			Map,
+			MapError,
+			// optimized nodes
+			Literals,
+			RepeatLiteral,
+			RepeatBytes,
+			// wrappers of one child, Program runs them as escapes
+			Memo,
+			Traced,
+			AstNode,
+			Named,
+			// choice reordering its alternatives by their hits
+			AdaptiveChoice,
+			// lookahead, wrappers of one child
+			Peek,
+			NotFollowedBy,
+			Recognize,
+			// binary input, the children of LengthPrefixed are the length and the body parser
+			Integer,
+			Varint,
+			Take,
+			LengthPrefixed
+		};
+
+		Kind kind;
+		// literal of Str, name of Regexp, Traced, Named, AdaptiveChoice and the binary parsers, name of a named Map
+		std::string text{};
+		std::vector<Parser> children{};
+		// rule of Lazy
+		std::function<Parser()> rule{};
+		// result transformer of Map
+		std::function<ParseResult(const ParseResult&)> map{};
+		// RepeatLiteral and RepeatBytes of plus
+		bool atLeastOne = false;
+		// Regexp built from a pattern string, for Program::write
+		std::string pattern{};
+		std::size_t lookahead = std::numeric_limits<std::size_t>::max();
+		// bytes of Take
+		std::size_t count = 0;
+	};
 
+	// Parsers are immutable once built: one instance (and a Program compiled from it) can run
+	// from any number of threads at once. Everything a run changes lives in its RunContext
+	// (memo table, line index, failures, depth), so a context, a MemoTable or a session object
+	// (IncrementalParser, PushParser, Program::Machine) belongs to one thread at a time.
+	// Callbacks given to map, chain, lazy and contextual must not change shared state either.
 	struct Parser
 	{
 		// parser transformer = ParserState in -> ParserState out
 		// can be lambda, function, method
 		std::function<ParserState(const ParserState& state)> transformerFn;
+		// grammar structure for Parsers::optimize, nullptr for opaque parsers (map, chain, lazy, ...)
+		std::shared_ptr<const GrammarNode> node{};
 
-		auto run(const std::string_view& targetString) const
-		{
-			ParserState initialState{ targetString , 0 };
-			return transformerFn(initialState);
-		}
+		ParserState run(const std::string_view& targetString) const;
+		// run with the caller's context, to query it afterwards (e.g. context.lines.position(state.index))
+		ParserState run(const std::string_view& targetString, RunContext& context) const;
+
+		// run over a token stream produced by Lexer (see Lexer.h), index is a token index
+		ParserState run(const TokenStream& tokens) const;
+		ParserState run(const TokenStream& tokens, RunContext& context) const;
+
+		// compiles to a Program for this one run and parses input read from the source (see Bytecode.h);
+		// for many runs compile the Program once and use Program::runAsync
+		template<typename Source>
+		Task<ParserState> runAsync(Source& source) const;
 
 		// parse result transformer = ParseResult in -> ParseResult out
 		// can be lambda, function, method
 		auto map(std::function<ParseResult(const ParseResult&)> fn) {
 			auto mapFn = [transformerFn = this->transformerFn, fn](const ParserState& state) {
 				const auto nextState = transformerFn(state);
-				if (nextState.isError) {
+				if (nextState.isError || skipValues(nextState)) {
 					return nextState;
 				}
+				if (!nextState.result.parts.empty()) {
+					return updateParserResult(nextState, fn(nextState.result.flattened()));
+				}
 				return updateParserResult(nextState, fn(nextState.result));
 				};
-			return Parser{ mapFn };
+			return Parser{ mapFn, std::make_shared<const GrammarNode>(GrammarNode{ GrammarNode::Kind::Map, {}, { *this }, {}, fn }) };
+		}
+
+		// named map, a Program read back from a file (see Program::write) gets fn back by the name
+		auto map(const std::string& name, std::function<ParseResult(const ParseResult&)> fn) {
+			auto parser = map(fn);
+			parser.node = std::make_shared<const GrammarNode>(GrammarNode{ GrammarNode::Kind::Map, name, { *this }, {}, fn });
+			return parser;
 		}
 
 		// parse result transformer = ParseState in -> switch Parser by result => ParseState out
 		// can be lambda, function, method
 		auto chain(std::function<const Parser(const ParseResult&)> fn) {
 			auto chainFn = [transformerFn = this->transformerFn, fn](const ParserState& state) {
+				// the callback needs the values in recognition and sink mode too, the matches of the parser
+				// reach it instead of the sink
+				auto* context = state.context;
+				const bool recognizing = context != nullptr && std::exchange(context->recognizing, false);
+				auto* sink = context != nullptr ? std::exchange(context->sink, nullptr) : nullptr;
 				const auto nextState = transformerFn(state);
+				if (context != nullptr) {
+					context->recognizing = recognizing;
+					context->sink = sink;
+				}
 				if (nextState.isError) {
 					return nextState;
 				}
-				const Parser nextParser = fn(nextState.result);
-				return nextParser.transformerFn(nextState);
+				const Parser nextParser = nextState.result.parts.empty() ? fn(nextState.result) : fn(nextState.result.flattened());
+				if (context == nullptr) {
+					return nextParser.transformerFn(nextState);
+				}
+				if (countStep(context)) {
+					return abortAtLimit(nextState);
+				}
+				if (context->depth >= context->maxDepth) {
+					return abortParser(nextState,
+						std::format("chain: Maximum nesting depth {} reached at index {}", context->maxDepth, nextState.index));
+				}
+				++context->depth;
+				if (context->stats != nullptr) {
+					context->stats->maxDepth = std::max<std::uint64_t>(context->stats->maxDepth, context->depth);
+				}
+				const auto chainState = nextParser.transformerFn(nextState);
+				--context->depth;
+				return chainState;
 				};
 			return Parser{ chainFn };
 		}
@@ -92,12 +683,27 @@ namespace Combinators {
 		auto mapError(std::function<std::string(const std::string&, std::size_t index)> fn) {
 			auto mapErrFn = [transformerFn = this->transformerFn, fn](const ParserState& state) {
 				const auto nextState = transformerFn(state);
-				if (!nextState.isError) {
+				if (!nextState.isError || isAborted(nextState) || isRecognizing(nextState)) {
+					return nextState;
+				}
+				return updateParserError(nextState, fn(errorMessage(nextState), nextState.index));
+				};
+			return Parser{ mapErrFn, std::make_shared<const GrammarNode>(GrammarNode{ GrammarNode::Kind::MapError, {}, { *this } }) };
+		}
+
+		// parse error transformer = errMsg and line/column in -> string out
+		auto mapErrorPosition(std::function<std::string(const std::string&, const Position&)> fn) {
+			auto mapErrFn = [transformerFn = this->transformerFn, fn](const ParserState& state) {
+				const auto nextState = transformerFn(state);
+				if (!nextState.isError || isAborted(nextState) || isRecognizing(nextState)) {
 					return nextState;
 				}
-				return updateParserError(nextState, fn(nextState.error, nextState.index));
+				const auto position = nextState.context != nullptr
+					? nextState.context->lines.position(nextState.index)
+					: LineIndex(nextState.targetString).position(nextState.index);
+				return updateParserError(nextState, fn(errorMessage(nextState), position));
 				};
-			return Parser{ mapErrFn };
+			return Parser{ mapErrFn, std::make_shared<const GrammarNode>(GrammarNode{ GrammarNode::Kind::MapError, {}, { *this } }) };
 		}
 
 	};
@@ -113,6 +719,8 @@ namespace Combinators {
 
 		owning_handle<promise_type>& operator=(const owning_handle<promise_type>&) = delete;
 		owning_handle<promise_type>& operator=(owning_handle<promise_type>&& other) {
+			if (handle_ != nullptr && handle_ != other.handle_)
+				handle_.destroy();
 			handle_ = std::exchange(other.handle_, nullptr);
 			return *this;
 		}
@@ -205,26 +813,136 @@ namespace Combinators {
 	};
 
 
+	// lazily started coroutine with a result, can be awaited by another coroutine
+	template<typename T>
+	struct Task
+	{
+		struct promise_type // required
+		{
+			using handle_t = std::coroutine_handle<promise_type>;
+			T value_{};
+			std::exception_ptr exception_;
+			// awaiting coroutine, resumed when the task is done
+			std::coroutine_handle<> continuation_;
+
+			// promise interface
+			Task get_return_object()
+			{
+				return Task(handle_t::from_promise(*this));
+			}
+			std::suspend_always initial_suspend() noexcept { return {}; }
+			auto final_suspend() noexcept {
+				struct awaiter {
+					bool await_ready() const noexcept { return false; }
+					std::coroutine_handle<> await_suspend(handle_t handle) const noexcept {
+						const auto continuation = handle.promise().continuation_;
+						return continuation ? continuation : std::noop_coroutine();
+					}
+					void await_resume() const noexcept {}
+				};
+				return awaiter{};
+			}
+			void unhandled_exception() { exception_ = std::current_exception(); } // saving
+			// exception
+
+			template<std::convertible_to<T> From> // C++20 concept
+			void return_value(From&& value) {
+				value_ = std::forward<From>(value);
+			}
+		};
+
+		owning_handle<promise_type> handle_;
+
+		explicit Task(promise_type::handle_t h) : handle_(h) {}
+
+		bool done() const { return handle_.done(); }
+
+		// run until the first suspension without an awaiting coroutine (e.g. from an event loop)
+		void start() { handle_.resume(); }
+
+		T result() {
+			if (handle_.promise().exception_) {
+				std::rethrow_exception(handle_.promise().exception_);
+			}
+			return std::move(handle_.promise().value_);
+		}
+
+		// awaitable interface
+		bool await_ready() const noexcept { return false; }
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<> continuation) {
+			handle_.promise().continuation_ = continuation;
+			return handle_.raw_handle();
+		}
+		T await_resume() { return result(); }
+	};
+
+
+	// attempts which can't undo any output aren't opened, their output reaches the sink without waiting:
+	// a choice alternative which never fails or fails without output, and the last one (the failed choice
+	// is undone by an outer attempt)
+	bool alternativeAttempt(const std::vector<Parser>& alternatives, std::size_t i);
+	// an iteration over a parser which fails without output and always consumes input
+	bool iterationAttempt(const Parser& parser);
+
 	struct Parsers {
 		static Parser str(const std::string& prefix);
-		static Parser regexp(const std::regex& re, const std::string_view& name = "regexp");
+		// lookahead - how many characters past the match (or past the index on failure) the regex can look,
+		// the result depends on them for memo rules and streaming input, unbounded by default
+		static Parser regexp(const std::regex& re, const std::string_view& name = "regexp",
+			std::size_t lookahead = std::numeric_limits<std::size_t>::max());
+		// ECMAScript pattern, kept in the node so a Program with the regexp can be written to a file
+		static Parser regexp(const std::string& pattern, const std::string_view& name = "regexp",
+			std::size_t lookahead = std::numeric_limits<std::size_t>::max());
 		static Parser letters();
 		static Parser digits();
+		// runs of Unicode letters (general category L), letters and decimal digits (Nd) and White_Space
+		// characters of UTF-8 input, ASCII runs are matched 32 bytes at a time
+		static Parser utf8Letters();
+		static Parser utf8Alnum();
+		static Parser utf8Whitespace();
+		// binary input (Binary.cpp): an integer of 1 to 8 bytes, its value in decimal
+		static Parser integer(std::size_t bytes, std::endian order = std::endian::little, bool isSigned = false);
+		// LEB128 integer of up to 10 bytes (protobuf varint), zigzag - signed with the zigzag encoding
+		static Parser varint(bool zigzag = false);
+		// count bytes as one value, not copied in sink mode (the token event has the span)
+		static Parser take(std::size_t count);
+		// field of the length given by the last value of lengthParser; bodyParser runs on a view of the input
+		// ending at the end of the field and must consume all of it. Without a body the field bytes are the value.
+		// The memo table is keyed by index only, so memo rules of the body run without it
+		static Parser lengthPrefixed(const Parser& lengthParser, const Parser& bodyParser);
+		static Parser lengthPrefixed(const Parser& lengthParser);
 		static Parser fail(const std::string& error);
 		static Parser succeed(const ParseResult& result = {});
 
+		// lookahead (Lookahead.cpp), the parser runs in recognition mode (see RunContext::recognizing) without output:
+		// peek succeeds where the parser matches, notFollowedBy where it fails, without consuming input or giving values
+		static Parser peek(const Parser& parser);
+		static Parser notFollowedBy(const Parser& parser);
+		// the input matched by the parser as one value, the source text of the tokens for token runs
+		static Parser recognize(const Parser& parser);
+
 		// runtime sequence
 		static Parser sequenceOf(const std::vector<Parser>& parsers);
 
 		// runtime choice
 		static Parser choice(const std::vector<Parser>& parsers);
+		// choice counting the matches of its alternatives in the profile under the name (Adaptive.cpp); every
+		// reorderInterval calls the alternatives matching most often move first. Only neighbours which can't match
+		// the same input (not nullable, disjoint FIRST sets, see GrammarAnalysis) trade places, the result stays
+		// the one of choice. The grammar is analyzed on the first call, when its lazy rules are complete
+		static Parser adaptiveChoice(const std::string& name, const std::vector<Parser>& parsers, ChoiceProfile& profile,
+			std::size_t reorderInterval = 1024);
 
+		// star, plus and sepBy_* throw std::invalid_argument for a parser which surely matches without consuming input
+		// (star(star(p)), str("")), a loop over it would never end; a match without consuming input ends the loops,
+		// for the parsers hiding it (lazy rules, regexp, ...), see GrammarAnalysis in Analysis.h
 		static Parser plus(const Parser& parser);
 		static Parser star(const Parser& parser);
 
 		// compile time sequence 
 		template<typename ... Parsers>
 		static auto sequenceOf(Parsers&& ... parsers) {
+			std::vector<Parser> children{ parsers... };
 			auto sequenceOf = [... parsers = std::forward<Parsers>(parsers)](const ParserState& state) {
 				if (state.isError) {
 					return state;
@@ -246,37 +964,52 @@ namespace Combinators {
 					return updateParserResult(nextState, result);
 				}
 			};
-			return Parser{ sequenceOf };
+			return optimize(Parser{ sequenceOf, node(GrammarNode::Kind::Sequence, std::move(children)) });
 		}
 
 		// compile time choice 
 		template<typename ... Parsers>
 		static auto choice(Parsers&& ... parsers) {
-			auto choice = [... parsers = std::forward<Parsers>(parsers)](const ParserState& state) {
+			std::vector<Parser> children{ parsers... };
+			std::array<bool, sizeof...(Parsers)> attempts{};
+			for (std::size_t i = 0; i < attempts.size(); ++i) {
+				attempts[i] = alternativeAttempt(children, i);
+			}
+			auto choice = [attempts, ... parsers = std::forward<Parsers>(parsers)](const ParserState& state) {
 				if (state.isError) {
 					return state;
 				}
 				auto nextState = state;
-				([&state, &nextState, parser = std::move(parsers)] {
+				std::size_t i = 0;
+				([&state, &nextState, &attempts, &i, parser = std::move(parsers)] {
+					const bool attempt = attempts[i++];
+					const auto output = attempt ? beginAttempt(state.context) : OutputMark{};
 					nextState = parser.transformerFn(state);
-					return nextState.isError;
+					if (attempt) {
+						endAttempt(state.context, output, !nextState.isError);
+					}
+					if (nextState.isError && !isAborted(nextState)) {
+						countBacktrack(state);
+						return true;
+					}
+					return false;
 					}() && ...);
 				// check result
-				if (!nextState.isError) {
+				if (!nextState.isError || isAborted(nextState)) {
 					return nextState;
 				}
 				else {
-					return updateParserError(state,
-						std::format("choice: Unable to match with any parser at index {}", state.index));
+					return updateParserFailure(state,
+						"choice: Unable to match with any parser at index {}", state.index);
 				}
 			};
-			return Parser{ choice };
+			return optimize(Parser{ choice, node(GrammarNode::Kind::Choice, std::move(children)) });
 		}
 
 
 		static auto between(const Parser& leftParser, const Parser& rightParser) {
 			auto between = [leftParser, rightParser](const Parser& contentParser) {
-				return Parsers::sequenceOf({
+				auto parser = Parsers::sequenceOf({
 					leftParser, contentParser, rightParser
 					}).map([](const ParseResult& result) -> ParseResult {
 						ParseResult ret;
@@ -285,74 +1018,153 @@ namespace Combinators {
 						}
 						return ret;
 					});
+				parser.node = node(GrammarNode::Kind::Between, { leftParser, contentParser, rightParser });
+				return optimize(parser);
 				};
 			return between;
 		}
 
 		static auto sepBy_star(const Parser& separatorParser) {
 			auto sepByWrapper = [separatorParser](const Parser& valueParser) {
-				auto sepBy = [separatorParser, valueParser](const ParserState& state) {
+				auto sepBy = [separatorParser, valueParser, valueAttempt = iterationAttempt(valueParser), loopId = MemoTable::newRuleId()](const ParserState& state) {
 					if (state.isError) {
 						return state;
 					}
 					ParseResult result;
 					auto nextState = state;
+					LoopChunks chunks(state, loopId);
 					while (true) {
+						if (countStep(state.context)) {
+							return abortAtLimit(nextState);
+						}
+						if (chunks.hop(nextState, result)) {
+							continue;
+						}
+						auto output = valueAttempt ? beginAttempt(state.context) : OutputMark{};
 						const auto valueState = valueParser.transformerFn(nextState);
+						if (valueAttempt) {
+							endAttempt(state.context, output, !valueState.isError);
+						}
 						if (valueState.isError) {
+							if (isAborted(valueState)) {
+								return valueState;
+							}
 							break;
 						}
 						result += valueState.result;
+						const auto valueStart = nextState.index;
 						nextState = valueState;
 
+						output = beginAttempt(state.context);
 						const auto separatorState = separatorParser.transformerFn(nextState);
-						if (separatorState.isError) {
+						// a value and separator without consuming input would repeat forever, they end the list
+						const bool repeated = !separatorState.isError && separatorState.index != valueStart;
+						endAttempt(state.context, output, repeated);
+						if (!repeated) {
+							if (isAborted(separatorState)) {
+								return separatorState;
+							}
 							break;
 						}
 						nextState = separatorState;
+						chunks.iterated(nextState, result);
 					}
 					return updateParserResult(nextState, result);
 				};
-				return Parser{ sepBy };
+				checkLoop("sepBy", { valueParser, separatorParser });
+				return Parser{ sepBy, node(GrammarNode::Kind::SepByStar, { separatorParser, valueParser }) };
 			};
 			return sepByWrapper;
 		}
 
 		static auto sepBy_plus(const Parser& separatorParser) {
 			auto sepByWrapper = [separatorParser](const Parser& valueParser) {
-				auto sepBy = [separatorParser, valueParser](const ParserState& state) {
+				auto sepBy = [separatorParser, valueParser, valueAttempt = iterationAttempt(valueParser), loopId = MemoTable::newRuleId()](const ParserState& state) {
 					if (state.isError) {
 						return state;
 					}
 					ParseResult result;
 					auto nextState = state;
+					// values can match without giving any (astNode, sink mode), so count the matches
+					bool matched = false;
+					LoopChunks chunks(state, loopId);
 					while (true) {
+						if (countStep(state.context)) {
+							return abortAtLimit(nextState);
+						}
+						if (chunks.hop(nextState, result)) {
+							matched = true;
+							continue;
+						}
+						auto output = valueAttempt ? beginAttempt(state.context) : OutputMark{};
 						const auto valueState = valueParser.transformerFn(nextState);
+						if (valueAttempt) {
+							endAttempt(state.context, output, !valueState.isError);
+						}
 						if (valueState.isError) {
+							if (isAborted(valueState)) {
+								return valueState;
+							}
 							break;
 						}
 						result += valueState.result;
+						const auto valueStart = nextState.index;
 						nextState = valueState;
+						matched = true;
 
+						output = beginAttempt(state.context);
 						const auto separatorState = separatorParser.transformerFn(nextState);
-						if (separatorState.isError) {
+						// a value and separator without consuming input would repeat forever, they end the list
+						const bool repeated = !separatorState.isError && separatorState.index != valueStart;
+						endAttempt(state.context, output, repeated);
+						if (!repeated) {
+							if (isAborted(separatorState)) {
+								return separatorState;
+							}
 							break;
 						}
 						nextState = separatorState;
+						chunks.iterated(nextState, result);
 					}
-					if (result.values.empty()) {
-						return updateParserError(state,
-							std::format("sepBy: Unable to capture any results at index {}", state.index));
+					if (!matched) {
+						return updateParserFailure(state,
+							"sepBy: Unable to capture any results at index {}", state.index);
 					}
 					return updateParserResult(nextState, result);
 				};
-				return Parser{ sepBy };
+				checkLoop("sepBy", { valueParser, separatorParser });
+				return Parser{ sepBy, node(GrammarNode::Kind::SepByPlus, { separatorParser, valueParser }) };
 			};
 			return sepByWrapper;
 		}
 
 		static Parser betweenBrackets(const Parser& contentParser);
 		static Parser lazy(std::function<Parser()> fn);
+		// remembers the results of the parser in RunContext::memo, plain parser without a memo table
+		static Parser memo(const Parser& parser);
+		// sepBy_star/sepBy_plus with a one character str separator, or star, parsing the elements on worker threads
+		// (a pool kept for the process) with the settings of the run and a share of its steps left each; their steps,
+		// stats, trace and failures join the run's. Element boundaries are guessed by a scan of bracket and quote
+		// nesting ([{( and "), a list whose elements don't end at the guessed boundaries or whose workers reach a limit
+		// is parsed by the sequential parser (the work of the workers isn't counted then).
+		// The element parser must not share mutable state between calls, memo tables are not used inside the list.
+		static Parser parallel(const Parser& parser, const ParallelOptions& options = {});
+		// named rule, its calls are recorded to RunContext::trace (see Trace.h) and reported to RunContext::sink
+		static Parser traced(const std::string& name, const Parser& parser);
+		// the parser under a name, a Program read back from a file gets it back by the name (see Program::write);
+		// for the parsers it can't write (chain, contextual, memo, ...)
+		static Parser named(const std::string& name, const Parser& parser);
+		// with RunContext::ast adds a node of the kind spanning the match, the nodes added by the parser
+		// become its children and its values are dropped; the plain parser without an Ast
+		static Parser astNode(std::uint32_t kind, const Parser& parser);
+
+		// rewrites the node of the parser (children are optimized when they are built):
+		// flattens nested sequences and choices, merges adjacent literals,
+		// scans star/plus over literals and single characters in bulk, removes the slicing map of between
+		static Parser optimize(const Parser& parser);
+		static std::shared_ptr<const GrammarNode> node(GrammarNode::Kind kind, std::vector<Parser> children, std::string text = {});
+		// throws std::invalid_argument when all the parsers of the loop body surely match without consuming input
+		static void checkLoop(const std::string& name, const std::vector<Parser>& body);
 
 		static Parser contextual(std::function<Generator<ParseResult, Parser>()> generatorFn) {
 			auto contextual = Parsers::succeed().chain([generatorFn](const ParseResult& result) -> const Parser {
@@ -386,7 +1198,8 @@ struct std::formatter<Combinators::ParseResult> {
 
 	// Define format() by calling the base class implementation with the wrapped value
 	auto format(const Combinators::ParseResult& t, std::format_context& fc) const {
-		auto str_results = t.values | std::views::transform([](auto word) { return std::format("\"{}\"", word); }) |
+		const auto values = t.flattened().values;
+		auto str_results = values | std::views::transform([](auto word) { return std::format("\"{}\"", word); }) |
 			std::views::join_with(',') | std::ranges::to<std::string>();
 		//		std::ranges::copy(t.results | std::views::transform([](auto word) { return std::format("\"{}\"", word); }) |
 		//							std::views::join_with(','), std::back_inserter(fc.out()));
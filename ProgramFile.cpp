@@ -0,0 +1,251 @@
+#include <fstream>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include "Bytecode.h"
+#include "Endian.h"
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Combinators {
+	static constexpr std::string_view programMagic = "PCPROG01";
+
+	// how an escape is written
+	enum class EscapeKind : std::uint8_t {
+		Named,
+		Regexp,
+		RepeatLiteral,
+		RepeatBytes
+	};
+
+	static void writeString(std::ostream& out, const std::string& text) {
+		writeInt<std::uint32_t>(out, static_cast<std::uint32_t>(text.length()));
+		out.write(text.data(), text.length());
+	}
+
+	// reads the image in place, every read is checked against its end
+	struct ImageReader
+	{
+		std::string_view image;
+		std::size_t offset = 0;
+
+		std::string_view take(std::size_t length) {
+			if (image.length() - offset < length) {
+				throw std::runtime_error("program: Unexpected end of the program image");
+			}
+			const auto bytes = image.substr(offset, length);
+			offset += length;
+			return bytes;
+		}
+
+		template<typename T>
+		T readInt() {
+			return decodeInt<T>(take(sizeof(T)));
+		}
+
+		std::string readString() {
+			const auto length = readInt<std::uint32_t>();
+			return std::string(take(length));
+		}
+	};
+
+	// compiles the pattern on the first run, a program with many regexps starts without building them
+	static Parser lazyRegexp(const std::string& pattern, const std::string& name, std::size_t lookahead) {
+		struct Compiled
+		{
+			std::once_flag once;
+			Parser parser;
+		};
+		auto compiled = std::make_shared<Compiled>();
+		auto regexp = [compiled, pattern, name, lookahead](const ParserState& state) {
+			std::call_once(compiled->once, [&]() { compiled->parser = Parsers::regexp(pattern, name, lookahead); });
+			return compiled->parser.transformerFn(state);
+		};
+		return Parser{ regexp, std::make_shared<const GrammarNode>(
+			GrammarNode{ GrammarNode::Kind::Regexp, name, {}, {}, {}, false, pattern, lookahead }) };
+	}
+
+	void Program::write(std::ostream& out) const {
+		using Kind = GrammarNode::Kind;
+		for (std::size_t i = 0; i < maps_.size(); ++i) {
+			if (mapNames_[i].empty()) {
+				throw std::invalid_argument(std::format("program: Map {} has no name, use Parser::map(name, fn)", i));
+			}
+		}
+		for (auto& escape : escapes_) {
+			const auto* node = escape.node.get();
+			const bool written = node != nullptr && (node->kind == Kind::Named || (node->kind == Kind::Regexp && !node->pattern.empty())
+				|| node->kind == Kind::RepeatLiteral || node->kind == Kind::RepeatBytes);
+			if (!written) {
+				throw std::invalid_argument("program: Escape parser can't be written, give it a name with Parsers::named");
+			}
+		}
+		out.write(programMagic.data(), programMagic.length());
+		writeInt<std::uint64_t>(out, maxStackDepth_);
+		writeInt<std::uint32_t>(out, static_cast<std::uint32_t>(code_.size()));
+		for (auto& instruction : code_) {
+			writeInt<std::uint8_t>(out, static_cast<std::uint8_t>(instruction.op));
+			writeInt<std::uint32_t>(out, instruction.arg);
+		}
+		writeInt<std::uint32_t>(out, static_cast<std::uint32_t>(literals_.size()));
+		for (auto& literal : literals_) {
+			writeString(out, literal);
+		}
+		writeInt<std::uint32_t>(out, static_cast<std::uint32_t>(mapNames_.size()));
+		for (auto& name : mapNames_) {
+			writeString(out, name);
+		}
+		writeInt<std::uint32_t>(out, static_cast<std::uint32_t>(escapes_.size()));
+		for (auto& escape : escapes_) {
+			const auto& node = *escape.node;
+			switch (node.kind) {
+			case Kind::Named:
+				writeInt<std::uint8_t>(out, static_cast<std::uint8_t>(EscapeKind::Named));
+				writeString(out, node.text);
+				break;
+			case Kind::Regexp:
+				writeInt<std::uint8_t>(out, static_cast<std::uint8_t>(EscapeKind::Regexp));
+				writeString(out, node.text);
+				writeString(out, node.pattern);
+				writeInt<std::uint64_t>(out, node.lookahead);
+				break;
+			default:
+				// the literal or the bytes of the alternatives
+				writeInt<std::uint8_t>(out, static_cast<std::uint8_t>(node.kind == Kind::RepeatLiteral ? EscapeKind::RepeatLiteral : EscapeKind::RepeatBytes));
+				writeString(out, node.text);
+				writeInt<std::uint8_t>(out, node.atLeastOne);
+				break;
+			}
+		}
+	}
+
+	Program Program::read(std::string_view image, const ProgramBindings& bindings) {
+		ImageReader reader{ image };
+		if (reader.take(std::min(programMagic.length(), image.length())) != programMagic) {
+			throw std::runtime_error("program: Not a program image");
+		}
+		Program program;
+		program.maxStackDepth_ = reader.readInt<std::uint64_t>();
+		const auto codeSize = reader.readInt<std::uint32_t>();
+		for (std::uint32_t i = 0; i < codeSize; ++i) {
+			const auto op = reader.readInt<std::uint8_t>();
+			const auto arg = reader.readInt<std::uint32_t>();
+			if (op > static_cast<std::uint8_t>(Opcode::End)) {
+				throw std::runtime_error(std::format("program: Unknown opcode {} at instruction {}", op, i));
+			}
+			program.code_.push_back(Instruction{ static_cast<Opcode>(op), arg });
+		}
+		const auto literalCount = reader.readInt<std::uint32_t>();
+		for (std::uint32_t i = 0; i < literalCount; ++i) {
+			program.literals_.push_back(reader.readString());
+			program.literalIds_.push_back(FurthestFailure::itemId(std::format("\"{}\"", program.literals_.back())));
+		}
+		const auto mapCount = reader.readInt<std::uint32_t>();
+		for (std::uint32_t i = 0; i < mapCount; ++i) {
+			auto name = reader.readString();
+			const auto found = bindings.maps.find(name);
+			if (found == bindings.maps.end()) {
+				throw std::runtime_error(std::format("program: No binding for map \"{}\"", name));
+			}
+			program.maps_.push_back(found->second);
+			program.mapNames_.push_back(std::move(name));
+		}
+		const auto escapeCount = reader.readInt<std::uint32_t>();
+		for (std::uint32_t i = 0; i < escapeCount; ++i) {
+			const auto kind = static_cast<EscapeKind>(reader.readInt<std::uint8_t>());
+			switch (kind) {
+			case EscapeKind::Named: {
+				auto name = reader.readString();
+				const auto found = bindings.parsers.find(name);
+				if (found == bindings.parsers.end()) {
+					throw std::runtime_error(std::format("program: No binding for parser \"{}\"", name));
+				}
+				program.escapes_.push_back(Parsers::named(name, found->second));
+				break;
+			}
+			case EscapeKind::Regexp: {
+				const auto name = reader.readString();
+				const auto pattern = reader.readString();
+				program.escapes_.push_back(lazyRegexp(pattern, name, reader.readInt<std::uint64_t>()));
+				break;
+			}
+			case EscapeKind::RepeatLiteral:
+			case EscapeKind::RepeatBytes: {
+				const auto text = reader.readString();
+				const bool atLeastOne = reader.readInt<std::uint8_t>() != 0;
+				std::vector<Parser> alternatives;
+				if (kind == EscapeKind::RepeatLiteral) {
+					alternatives.push_back(Parsers::str(text));
+				}
+				else {
+					for (auto byte : text) {
+						alternatives.push_back(Parsers::str(std::string(1, byte)));
+					}
+				}
+				const auto repeated = alternatives.size() == 1 ? alternatives[0] : Parsers::choice(std::as_const(alternatives));
+				program.escapes_.push_back(Parsers::optimize(atLeastOne ? Parsers::plus(repeated) : Parsers::star(repeated)));
+				break;
+			}
+			default:
+				throw std::runtime_error(std::format("program: Unknown escape kind {}", static_cast<int>(kind)));
+			}
+		}
+		// the arguments index the tables and the code, a damaged image mustn't run out of them
+		for (std::size_t i = 0; i < program.code_.size(); ++i) {
+			const auto [op, arg] = program.code_[i];
+			const auto limit = op == Opcode::Literal ? program.literals_.size()
+				: op == Opcode::Escape ? program.escapes_.size()
+				: op == Opcode::Map ? program.maps_.size()
+				: op == Opcode::Choice || op == Opcode::Commit || op == Opcode::Call ? program.code_.size()
+				: std::numeric_limits<std::size_t>::max();
+			if (arg >= limit) {
+				throw std::runtime_error(std::format("program: Argument {} out of range at instruction {}", arg, i));
+			}
+		}
+		if (std::ranges::none_of(program.code_, [](const Instruction& instruction) { return instruction.op == Opcode::End; })) {
+			throw std::runtime_error("program: Program image without an End instruction");
+		}
+		return program;
+	}
+
+	Program Program::readFile(const std::string& path, const ProgramBindings& bindings) {
+#ifndef _WIN32
+		const int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			throw std::runtime_error(std::format("program: Unable to open {}", path));
+		}
+		struct stat status {};
+		if (::fstat(fd, &status) != 0 || status.st_size == 0) {
+			::close(fd);
+			throw std::runtime_error(std::format("program: Unable to read {}", path));
+		}
+		const auto size = static_cast<std::size_t>(status.st_size);
+		void* data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if (data == MAP_FAILED) {
+			throw std::runtime_error(std::format("program: Unable to map {}", path));
+		}
+		// the program copies what it keeps, the mapping ends with the read
+		struct Unmap
+		{
+			void* data;
+			std::size_t size;
+			~Unmap() {
+				::munmap(data, size);
+			}
+		} unmap{ data, size };
+		return read(std::string_view(static_cast<const char*>(data), size), bindings);
+#else
+		std::ifstream in(path, std::ios::binary);
+		if (!in) {
+			throw std::runtime_error(std::format("program: Unable to open {}", path));
+		}
+		const std::string image{ std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>() };
+		return read(image, bindings);
+#endif
+	}
+}
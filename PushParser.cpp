@@ -0,0 +1,46 @@
+#include "PushParser.h"
+
+namespace Combinators {
+	PushParser::PushParser(Program program) : program_(std::move(program)), machine_(program_) {}
+
+	PushParser::PushParser(const Parser& parser) : PushParser(Program::compile(parser)) {}
+
+	ParseStatus PushParser::resume(bool final) {
+		status_ = machine_.resume(input_, final, context_);
+		return status_;
+	}
+
+	ParseStatus PushParser::feed(const std::string_view& bytes) {
+		input_ += bytes;
+		if (status_ != ParseStatus::NeedMore) {
+			return status_;
+		}
+		return resume(false);
+	}
+
+	ParseStatus PushParser::finish() {
+		if (status_ != ParseStatus::NeedMore) {
+			return status_;
+		}
+		return resume(true);
+	}
+
+	std::string_view PushParser::rest() const {
+		if (status_ != ParseStatus::Complete) {
+			return {};
+		}
+		return std::string_view(input_).substr(machine_.state().index);
+	}
+
+	ParseStatus PushParser::reset() {
+		if (status_ == ParseStatus::Complete) {
+			input_.erase(0, machine_.state().index);
+		}
+		else {
+			input_.clear();
+		}
+		machine_ = Program::Machine(program_);
+		context_ = RunContext{};
+		return resume(false);
+	}
+}
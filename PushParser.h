@@ -0,0 +1,47 @@
+#pragma once
+#include "Bytecode.h"
+
+namespace Combinators {
+	// Parses a message from input pushed in fragments of any size (e.g. network reads).
+	// The bytecode machine stops where the input ran out and continues there on the next feed,
+	// so a slowly arriving message is parsed once, not from the start on every fragment.
+	class PushParser
+	{
+	public:
+		explicit PushParser(Program program);
+		explicit PushParser(const Parser& parser);
+
+		// the machine points into the owned program
+		PushParser(const PushParser&) = delete;
+		PushParser& operator=(const PushParser&) = delete;
+
+		// appends bytes to the message, input after a complete or failed message is kept for the next one
+		ParseStatus feed(const std::string_view& bytes);
+		// no more input will come, the message is complete or failed then
+		ParseStatus finish();
+
+		ParseStatus status() const {
+			return status_;
+		}
+
+		// result of a complete or failed message, targetString is valid until the next feed or reset
+		const ParserState& state() const {
+			return machine_.state();
+		}
+
+		// input received after the end of the complete message
+		std::string_view rest() const;
+
+		// starts the next message with the rest of the input (all of it is dropped after an error)
+		ParseStatus reset();
+
+	private:
+		ParseStatus resume(bool final);
+
+		Program program_;
+		Program::Machine machine_;
+		RunContext context_{};
+		std::string input_;
+		ParseStatus status_ = ParseStatus::NeedMore;
+	};
+}
@@ -0,0 +1,107 @@
+#include <mutex>
+#ifdef COMBINATORS_COUNT_ALLOCATIONS
+#include <cstdlib>
+#include <new>
+#endif
+#include "ParserCombinators.h"
+
+namespace Combinators {
+	RunStats& RunStats::operator+=(const RunStats& stats) {
+		runs += stats.runs;
+		invocations += stats.invocations;
+		backtracks += stats.backtracks;
+		maxDepth = std::max(maxDepth, stats.maxDepth);
+		examined += stats.examined;
+		consumed += stats.consumed;
+		allocations += stats.allocations;
+		allocatedBytes += stats.allocatedBytes;
+		errors += stats.errors;
+		return *this;
+	}
+
+	static std::mutex totalMutex;
+	static RunStats totalStats;
+
+	void RunStats::addToTotal(const RunStats& stats) {
+		std::lock_guard lock(totalMutex);
+		totalStats += stats;
+	}
+
+	RunStats RunStats::total() {
+		std::lock_guard lock(totalMutex);
+		return totalStats;
+	}
+
+	std::string RunStats::exportTotal() {
+		const auto stats = total();
+		std::string text;
+		auto metric = [&text](std::string_view name, std::string_view type, std::string_view help, std::uint64_t value) {
+			text += std::format("# HELP combinators_{} {}\n", name, help);
+			text += std::format("# TYPE combinators_{} {}\n", name, type);
+			text += std::format("combinators_{} {}\n", name, value);
+		};
+		metric("runs_total", "counter", "Runs with statistics.", stats.runs);
+		metric("invocations_total", "counter", "Primitive parsers and rules called.", stats.invocations);
+		metric("backtracks_total", "counter", "Failed choice alternatives.", stats.backtracks);
+		metric("max_depth", "gauge", "Deepest nesting of a run.", stats.maxDepth);
+		metric("examined_bytes_total", "counter", "Input looked at.", stats.examined);
+		metric("consumed_bytes_total", "counter", "Input consumed.", stats.consumed);
+		metric("allocations_total", "counter", "Heap allocations during runs.", stats.allocations);
+		metric("allocated_bytes_total", "counter", "Heap bytes allocated during runs.", stats.allocatedBytes);
+		metric("errors_total", "counter", "Error messages built.", stats.errors);
+		return text;
+	}
+
+#ifdef COMBINATORS_COUNT_ALLOCATIONS
+	static thread_local std::uint64_t allocationCount = 0;
+	static thread_local std::uint64_t allocatedByteCount = 0;
+
+	std::pair<std::uint64_t, std::uint64_t> allocationCounters() {
+		return { allocationCount, allocatedByteCount };
+	}
+#else
+	std::pair<std::uint64_t, std::uint64_t> allocationCounters() {
+		return { 0, 0 };
+	}
+#endif
+}
+
+#ifdef COMBINATORS_COUNT_ALLOCATIONS
+// counting hook for RunStats, replaces the global allocation functions of the program
+void* operator new(std::size_t size) {
+	++Combinators::allocationCount;
+	Combinators::allocatedByteCount += size;
+	if (auto* memory = std::malloc(size != 0 ? size : 1)) {
+		return memory;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept {
+	std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept {
+	std::free(memory);
+}
+
+// over-aligned types, the array and nothrow forms call these two
+void* operator new(std::size_t size, std::align_val_t alignment) {
+	++Combinators::allocationCount;
+	Combinators::allocatedByteCount += size;
+	const auto align = static_cast<std::size_t>(alignment);
+	// aligned_alloc wants a multiple of the alignment
+	if (auto* memory = std::aligned_alloc(align, (std::max<std::size_t>(size, 1) + align - 1) / align * align)) {
+		return memory;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void* memory, std::align_val_t) noexcept {
+	std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t, std::align_val_t) noexcept {
+	std::free(memory);
+}
+#endif
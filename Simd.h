@@ -0,0 +1,7 @@
+#pragma once
+// SSE2 (every x86-64 and x86 built for it) scans 16 bytes at once where COMBINATORS_SSE2 is defined,
+// other targets use the byte loops
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define COMBINATORS_SSE2
+#endif
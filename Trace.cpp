@@ -0,0 +1,235 @@
+#include <cctype>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include "Endian.h"
+#include "Trace.h"
+
+namespace Combinators {
+	static constexpr std::string_view traceMagic = "PCTRACE1";
+	static constexpr const char* traceEnd = "trace: Unexpected end of the trace log";
+
+	TraceBuffer::TraceBuffer(std::size_t capacity)
+		: ring_(std::max<std::size_t>(capacity, 1)), origin_(std::chrono::steady_clock::now()) {}
+
+	void TraceBuffer::append(const TraceBuffer& other) {
+		// the other buffer counts from its own creation
+		const auto shift = std::chrono::duration_cast<std::chrono::nanoseconds>(other.origin_ - origin_).count();
+		recorded_ += other.dropped();
+		for (auto event : other.events()) {
+			event.start = static_cast<std::uint64_t>(static_cast<std::int64_t>(event.start) + shift);
+			record(event);
+		}
+	}
+
+	std::vector<TraceEvent> TraceBuffer::events() const {
+		const auto kept = std::min<std::uint64_t>(recorded_, ring_.size());
+		std::vector<TraceEvent> events;
+		events.reserve(kept);
+		for (auto i = recorded_ - kept; i < recorded_; ++i) {
+			events.push_back(ring_[i % ring_.size()]);
+		}
+		return events;
+	}
+
+	std::uint64_t TraceBuffer::dropped() const {
+		return recorded_ > ring_.size() ? recorded_ - ring_.size() : 0;
+	}
+
+	void TraceBuffer::write(std::ostream& out) const {
+		const auto kept = events();
+		std::map<std::uint32_t, std::string> names;
+		for (auto& event : kept) {
+			if (!names.contains(event.ruleId)) {
+				names[event.ruleId] = FurthestFailure::itemName(event.ruleId);
+			}
+		}
+		out.write(traceMagic.data(), traceMagic.length());
+		writeInt<std::uint64_t>(out, dropped());
+		writeInt<std::uint32_t>(out, static_cast<std::uint32_t>(names.size()));
+		for (auto& [id, name] : names) {
+			writeInt<std::uint32_t>(out, id);
+			writeInt<std::uint32_t>(out, static_cast<std::uint32_t>(name.length()));
+			out.write(name.data(), name.length());
+		}
+		writeInt<std::uint64_t>(out, kept.size());
+		for (auto& event : kept) {
+			writeInt<std::uint32_t>(out, event.ruleId);
+			writeInt<std::uint8_t>(out, event.success);
+			writeInt<std::uint64_t>(out, event.offset);
+			writeInt<std::uint64_t>(out, event.start);
+			writeInt<std::uint64_t>(out, event.duration);
+		}
+	}
+
+	// rule id, success, offset, start and duration
+	static constexpr std::uint64_t eventBytes = 4 + 1 + 8 + 8 + 8;
+
+	TraceLog TraceLog::read(std::istream& in) {
+		std::string magic(traceMagic.length(), '\0');
+		if (!in.read(magic.data(), magic.length()) || magic != traceMagic) {
+			throw std::runtime_error("trace: Not a trace log");
+		}
+		TraceLog log;
+		log.dropped = readInt<std::uint64_t>(in, traceEnd);
+		const auto nameCount = readInt<std::uint32_t>(in, traceEnd);
+		for (std::uint32_t i = 0; i < nameCount; ++i) {
+			const auto id = readInt<std::uint32_t>(in, traceEnd);
+			log.names[id] = readBytes(in, readInt<std::uint32_t>(in, traceEnd), traceEnd);
+		}
+		const auto eventCount = readInt<std::uint64_t>(in, traceEnd);
+		const auto left = bytesLeft(in);
+		if (eventCount > left / eventBytes) {
+			throw std::runtime_error(traceEnd);
+		}
+		// reserved when the count was checked against the stream
+		if (left != std::numeric_limits<std::uint64_t>::max()) {
+			log.events.reserve(eventCount);
+		}
+		for (std::uint64_t i = 0; i < eventCount; ++i) {
+			TraceEvent event;
+			event.ruleId = readInt<std::uint32_t>(in, traceEnd);
+			event.success = readInt<std::uint8_t>(in, traceEnd) != 0;
+			event.offset = readInt<std::uint64_t>(in, traceEnd);
+			event.start = readInt<std::uint64_t>(in, traceEnd);
+			event.duration = readInt<std::uint64_t>(in, traceEnd);
+			log.events.push_back(event);
+		}
+		return log;
+	}
+
+	static std::string jsonString(const std::string_view& text) {
+		std::string json = "\"";
+		for (auto c : text) {
+			if (c == '"' || c == '\\') {
+				json += '\\';
+				json += c;
+			}
+			else if (static_cast<unsigned char>(c) < 0x20) {
+				json += std::format("\\u{:04x}", static_cast<int>(c));
+			}
+			else {
+				json += c;
+			}
+		}
+		return json + "\"";
+	}
+
+	std::string TraceLog::toChromeJson() const {
+		// microseconds with nanosecond fractions
+		auto micros = [](std::uint64_t nanos) {
+			return std::format("{}.{:03}", nanos / 1000, nanos % 1000);
+		};
+		std::string json = "{\"traceEvents\":[";
+		for (std::size_t i = 0; i < events.size(); ++i) {
+			const auto& event = events[i];
+			const auto found = names.find(event.ruleId);
+			json += std::format("{}\n{{\"name\":{},\"cat\":\"rule\",\"ph\":\"X\",\"ts\":{},\"dur\":{},\"pid\":1,\"tid\":1,"
+				"\"args\":{{\"offset\":{},\"success\":{}}}}}",
+				i == 0 ? "" : ",",
+				jsonString(found != names.end() ? found->second : std::format("rule {}", event.ruleId)),
+				micros(event.start), micros(event.duration), event.offset, event.success);
+		}
+		json += std::format("\n],\"displayTimeUnit\":\"ns\",\"otherData\":{{\"dropped\":{}}}}}\n", dropped);
+		return json;
+	}
+
+	std::vector<TraceLog::RuleSummary> TraceLog::summary() const {
+		// parents first: earlier start, on the same start the longer call
+		auto sorted = events;
+		std::ranges::sort(sorted, [](const TraceEvent& a, const TraceEvent& b) {
+			return a.start != b.start ? a.start < b.start : a.duration > b.duration;
+		});
+		std::map<std::uint32_t, RuleSummary> rules;
+		// open calls and the time of their direct children
+		std::vector<std::pair<const TraceEvent*, std::uint64_t>> open;
+		auto close = [&rules](const TraceEvent& event, std::uint64_t children) {
+			auto& rule = rules[event.ruleId];
+			rule.self += event.duration - std::min(children, event.duration);
+		};
+		for (auto& event : sorted) {
+			while (!open.empty() && open.back().first->start + open.back().first->duration <= event.start) {
+				close(*open.back().first, open.back().second);
+				open.pop_back();
+			}
+			if (!open.empty()) {
+				open.back().second += event.duration;
+			}
+			auto& rule = rules[event.ruleId];
+			++rule.calls;
+			rule.failures += event.success ? 0 : 1;
+			rule.total += event.duration;
+			open.emplace_back(&event, 0);
+		}
+		while (!open.empty()) {
+			close(*open.back().first, open.back().second);
+			open.pop_back();
+		}
+		std::vector<RuleSummary> summary;
+		for (auto& [id, rule] : rules) {
+			const auto found = names.find(id);
+			rule.name = found != names.end() ? found->second : std::format("rule {}", id);
+			summary.push_back(std::move(rule));
+		}
+		std::ranges::stable_sort(summary, [](const RuleSummary& a, const RuleSummary& b) {
+			return a.self > b.self;
+		});
+		return summary;
+	}
+
+	std::string TraceLog::summaryText() const {
+		std::string text = std::format("{:<24} {:>10} {:>10} {:>14} {:>14}\n", "rule", "calls", "failures", "total ns", "self ns");
+		for (auto& rule : summary()) {
+			text += std::format("{:<24} {:>10} {:>10} {:>14} {:>14}\n", rule.name, rule.calls, rule.failures, rule.total, rule.self);
+		}
+		if (dropped != 0) {
+			text += std::format("{} older calls were dropped\n", dropped);
+		}
+		return text;
+	}
+
+	std::string anonymizeInput(const std::string_view& input) {
+		std::string shape(input);
+		for (auto& c : shape) {
+			const auto byte = static_cast<unsigned char>(c);
+			if (std::isdigit(byte)) {
+				c = '0';
+			}
+			else if (std::islower(byte)) {
+				c = 'a';
+			}
+			else if (std::isupper(byte)) {
+				c = 'A';
+			}
+		}
+		return shape;
+	}
+
+	Parser Parsers::traced(const std::string& name, const Parser& parser) {
+		auto traced = [parser, ruleId = FurthestFailure::itemId(name)](const ParserState& state) {
+			if (state.isError) {
+				return state;
+			}
+			auto* trace = state.context != nullptr ? state.context->trace : nullptr;
+			auto* sink = runSink(state);
+			if (trace == nullptr && sink == nullptr) {
+				return parser.transformerFn(state);
+			}
+			if (sink != nullptr) {
+				sink->event(SinkEvent{ SinkEvent::Kind::Enter, ruleId, state.index, state.index });
+			}
+			const auto start = trace != nullptr ? trace->now() : 0;
+			const auto nextState = parser.transformerFn(state);
+			if (trace != nullptr) {
+				trace->record(TraceEvent{ ruleId, !nextState.isError, state.index, start, trace->now() - start });
+			}
+			if (sink != nullptr && !isAborted(nextState)) {
+				sink->event(SinkEvent{ SinkEvent::Kind::Exit, ruleId, state.index,
+					nextState.isError ? state.index : nextState.index, !nextState.isError });
+			}
+			return nextState;
+		};
+		// a wrapper node, the optimizer and Program keep the calls
+		return Parser{ traced, Parsers::node(GrammarNode::Kind::Traced, { parser }, name) };
+	}
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <chrono>
+#include <iosfwd>
+#include "ParserCombinators.h"
+
+namespace Combinators {
+	// one call of a Parsers::traced rule, no input data
+	struct TraceEvent
+	{
+		// rule name id (FurthestFailure::itemId)
+		std::uint32_t ruleId = 0;
+		bool success = false;
+		// input index where the call started
+		std::uint64_t offset = 0;
+		// nanoseconds since the trace buffer was created
+		std::uint64_t start = 0;
+		std::uint64_t duration = 0;
+		bool operator==(const TraceEvent&) const = default;
+	};
+
+	// Fixed size ring of trace events for one run at a time, the oldest events are overwritten.
+	// Events are recorded when a call ends, so nested calls come before their parent.
+	class TraceBuffer
+	{
+	public:
+		explicit TraceBuffer(std::size_t capacity = 1 << 16);
+
+		void record(const TraceEvent& event) {
+			ring_[recorded_++ % ring_.size()] = event;
+		}
+
+		// nanoseconds since the buffer was created
+		std::uint64_t now() const {
+			return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now() - origin_).count());
+		}
+
+		// records the events of a buffer filled on another thread (see Parsers::parallel) after the ones so far
+		void append(const TraceBuffer& other);
+
+		std::size_t capacity() const {
+			return ring_.size();
+		}
+
+		// the kept events, oldest first
+		std::vector<TraceEvent> events() const;
+		// overwritten events
+		std::uint64_t dropped() const;
+
+		// binary log with the names of the recorded rules
+		void write(std::ostream& out) const;
+
+	private:
+		std::vector<TraceEvent> ring_;
+		std::uint64_t recorded_ = 0;
+		std::chrono::steady_clock::time_point origin_;
+	};
+
+	// trace read back from the binary log, for offline tools
+	struct TraceLog
+	{
+		std::map<std::uint32_t, std::string> names;
+		std::vector<TraceEvent> events;
+		std::uint64_t dropped = 0;
+
+		// throws std::runtime_error for a stream which isn't a trace log
+		static TraceLog read(std::istream& in);
+
+		// Chrome trace / Perfetto JSON, one complete event per call
+		std::string toChromeJson() const;
+
+		struct RuleSummary
+		{
+			std::string name;
+			std::uint64_t calls = 0;
+			std::uint64_t failures = 0;
+			// nanoseconds, self excludes the nested traced calls
+			std::uint64_t total = 0;
+			std::uint64_t self = 0;
+		};
+		// per rule totals, most self time first
+		std::vector<RuleSummary> summary() const;
+		// summary() as a text table
+		std::string summaryText() const;
+	};
+
+	// input with letters replaced by a/A and digits by 0, other bytes kept:
+	// the structure of a slow input without its content, to reproduce it locally
+	std::string anonymizeInput(const std::string_view& input);
+}
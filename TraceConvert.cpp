@@ -0,0 +1,34 @@
+#include <fstream>
+#include <iostream>
+#include "Trace.h"
+
+using namespace Combinators;
+
+// offline converter of binary trace logs (TraceBuffer::write)
+// usage: ParserCombinators_trace <trace log> [--summary]
+int main(int argc, char* argv[])
+{
+	if (argc < 2) {
+		std::cerr << "usage: " << argv[0] << " <trace log> [--summary]\n";
+		return 2;
+	}
+	std::ifstream in(argv[1], std::ios::binary);
+	if (!in) {
+		std::cerr << "can't open " << argv[1] << "\n";
+		return 1;
+	}
+	try {
+		const auto log = TraceLog::read(in);
+		if (argc > 2 && std::string_view(argv[2]) == "--summary") {
+			std::cout << log.summaryText();
+		}
+		else {
+			std::cout << log.toChromeJson();
+		}
+	}
+	catch (const std::exception& e) {
+		std::cerr << e.what() << "\n";
+		return 1;
+	}
+	return 0;
+}
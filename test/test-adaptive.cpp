@@ -0,0 +1,69 @@
+TEST_CASE("adaptive choice") {
+	auto backtracks = [](const Parser& parser, const std::string& input) {
+		RunStats stats;
+		RunContext context{ .stats = &stats };
+		CHECK(!parser.run(input, context).isError);
+		return stats.backtracks;
+	};
+
+	// "gamma" and "g" overlap, "g" keeps its place after "gamma"
+	ChoiceProfile profile;
+	const std::vector<Parser> keywords{ Parsers::str("alpha"), Parsers::str("beta"), Parsers::str("gamma"), Parsers::str("g") };
+	const auto adaptive = Parsers::adaptiveChoice("keyword", keywords, profile, 4);
+	const auto fixed = Parsers::choice(keywords);
+	for (auto input : { "alpha", "beta", "gamma", "go", "delta" }) {
+		CAPTURE(input);
+		CHECK(adaptive.run(input) == fixed.run(input));
+	}
+	CHECK(backtracks(adaptive, "gamma") == 2);
+	for (int i = 0; i < 8; ++i) {
+		adaptive.run("gamma");
+	}
+	CHECK(profile.counts() == std::map<std::string, std::vector<std::uint64_t>>{ { "keyword", { 1, 1, 10, 1 } } });
+	CHECK(backtracks(adaptive, "gamma") == 0);
+	CHECK(backtracks(adaptive, "go") == 3);
+	CHECK(adaptive.run("go") == ParserState{ "go", 1, { { "g" } } });
+
+	// nullable and opaque alternatives stay where they are, so do their neighbours
+	ChoiceProfile fenceProfile;
+	fenceProfile.counters("fenced", 4)->hits[3] = 100;
+	const auto fenced = Parsers::adaptiveChoice("fenced",
+		{ Parsers::str("a"), Parsers::str(""), Parsers::regexp(std::string("b+"), "bs"), Parsers::str("b") }, fenceProfile, 1);
+	CHECK(fenced.run("bb") == ParserState{ "bb", 0, { { "" } } });
+	fenceProfile.counters("opaque", 2)->hits[1] = 100;
+	CHECK(Parsers::adaptiveChoice("opaque", { Parsers::regexp(std::string("b+"), "bs"), Parsers::str("b") }, fenceProfile, 1).run("bb")
+		== ParserState{ "bb", 2, { { "bb" } } });
+
+	// a profile written from one grammar orders the choice of the next from its first run
+	std::stringstream written;
+	profile.write(written);
+	ChoiceProfile loaded;
+	loaded.load(written);
+	CHECK(loaded.counts() == profile.counts());
+	const auto baked = Parsers::adaptiveChoice("keyword", keywords, loaded);
+	CHECK(backtracks(baked, "gamma") == 0);
+	std::stringstream notProfile("not a profile");
+	CHECK_THROWS_AS(loaded.load(notProfile), std::runtime_error);
+	// the name length and the number of alternatives past the end, after the magic and the choice count
+	auto damaged = [&written](std::size_t offset) {
+		auto text = written.str();
+		text.replace(offset, 4, std::string(4, '\xff'));
+		std::stringstream in(text);
+		ChoiceProfile profile;
+		CHECK_THROWS_AS(profile.load(in), std::runtime_error);
+		CHECK(profile.counts().empty());
+	};
+	damaged(12);
+	damaged(16 + std::string("keyword").length());
+	// the counters of a choice with other alternatives stay as they are
+	ChoiceProfile other;
+	const auto fewer = Parsers::adaptiveChoice("keyword", { Parsers::str("a") }, other);
+	std::stringstream again(written.str());
+	CHECK_THROWS_AS(other.load(again), std::runtime_error);
+	CHECK(other.counts() == std::map<std::string, std::vector<std::uint64_t>>{ { "keyword", { 0 } } });
+
+	// the analysis sees through it, Program runs it as an escape
+	CHECK(GrammarAnalysis::analyze(adaptive).first(adaptive).bytes.count() == 3);
+	CHECK(Program::compile(Parsers::sequenceOf(adaptive, Parsers::str("!"))).run("beta!")
+		== ParserState{ "beta!", 5, { { "beta", "!" } } });
+}
@@ -0,0 +1,45 @@
+TEST_CASE("adversarial inputs and growth") {
+	// S <- "a" S "b" / "a" S "c" / "a": every level parses the rest twice on a run of "a"
+	Parser exponential;
+	auto rule = Parsers::lazy([&exponential]() { return exponential; });
+	exponential = Parsers::choice(
+		Parsers::sequenceOf(Parsers::str("a"), rule, Parsers::str("b")),
+		Parsers::sequenceOf(Parsers::str("a"), rule, Parsers::str("c")),
+		Parsers::str("a"));
+
+	// the measured runs don't count in the totals of the process
+	const auto total = RunStats::total();
+	CHECK(measureRun(exponential, "aaaa").steps > 0);
+	CHECK(RunStats::total() == total);
+
+	AdversarialOptions options{ .maxLength = 20, .iterations = 300, .runLimit = std::chrono::milliseconds(50) };
+	const auto found = findAdversarialInput(exponential, options);
+	CHECK(found.input.length() <= 20);
+	CHECK(std::ranges::count(found.input, 'a') >= 8);
+	CHECK(found.stepsPerByte > 10 * measureRun(exponential, "abc").steps / 3.0);
+
+	auto as = [](std::size_t size) { return std::string(size, 'a'); };
+	const std::array<std::size_t, 4> factors{ 1, 2, 4, 8 };
+	CHECK(!growsLinearly(measureGrowth(exponential, as, 2, factors), 4));
+
+	// the same grammar with memo rules is linear
+	Parser memoized;
+	auto memoRule = Parsers::memo(Parsers::lazy([&memoized]() { return memoized; }));
+	memoized = Parsers::choice(
+		Parsers::sequenceOf(Parsers::str("a"), memoRule, Parsers::str("b")),
+		Parsers::sequenceOf(Parsers::str("a"), memoRule, Parsers::str("c")),
+		Parsers::str("a"));
+	const auto memoPoints = measureGrowth(memoized, as, 8, factors);
+	CHECK(growsLinearly(memoPoints, 1.5));
+	CHECK(memoPoints.back().bytes == 64);
+
+	// the reference grammars, 1x to 64x
+	for (auto format : { Grammars::Format::Json, Grammars::Format::Csv, Grammars::Format::Ini, Grammars::Format::Arithmetic }) {
+		CAPTURE(Grammars::formatName(format));
+		const auto points = measureGrowth(Grammars::grammar(format),
+			[format](std::size_t size) { return Grammars::corpus(format, size); }, 1 << 10);
+		CHECK(points.size() == 7);
+		CHECK(std::ranges::all_of(points, [](const GrowthPoint& point) { return point.cost.matched; }));
+		CHECK(growsLinearly(points, 2));
+	}
+}
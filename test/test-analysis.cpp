@@ -0,0 +1,84 @@
+TEST_CASE("grammar analysis") {
+	using Kind = GrammarWarning::Kind;
+	auto warnings = [](const GrammarAnalysis& analysis, Kind kind) {
+		std::vector<std::string> messages;
+		for (auto& warning : analysis.warnings()) {
+			if (warning.kind == kind) {
+				messages.push_back(warning.message);
+			}
+		}
+		return messages;
+	};
+
+	// loops which never end are rejected when they are built
+	CHECK(nullable(Parsers::star(Parsers::str("a"))) == Nullable::Yes);
+	CHECK(nullable(Parsers::letters()) == Nullable::Unknown);
+	CHECK(nullable(Parsers::sequenceOf(Parsers::letters(), Parsers::str("a"))) == Nullable::No);
+	CHECK_THROWS_AS(Parsers::star(Parsers::star(Parsers::str("a"))), std::invalid_argument);
+	CHECK_THROWS_AS(Parsers::plus(Parsers::str("")), std::invalid_argument);
+	CHECK_THROWS_AS(Parsers::sepBy_star(Parsers::star(Parsers::str(",")))(Parsers::star(Parsers::digits())), std::invalid_argument);
+	CHECK_NOTHROW(Parsers::sepBy_star(Parsers::star(Parsers::str(",")))(Parsers::digits()));
+
+	// hidden ones end at the first match without consuming input
+	CHECK(Parsers::star(Parsers::succeed(ParseResult{ { "x" } })).run("ab") == ParserState{ "ab", 0, {} });
+	CHECK(Parsers::plus(Parsers::succeed(ParseResult{ { "x" } })).run("ab") == ParserState{ "ab", 0, { { "x" } } });
+	auto as = Parsers::star(Parsers::regexp(std::regex("a*"), "as"));
+	CHECK(as.run("aab") == ParserState{ "aab", 2, { { "aa" } } });
+	CHECK(Program::compile(as).run("aab") == ParserState{ "aab", 2, { { "aa" } } });
+	auto list = Parsers::sepBy_plus(Parsers::regexp(std::regex(",?"), "comma"))(Parsers::regexp(std::regex("[0-9]*"), "number"));
+	CHECK(list.run("1,2x") == ParserState{ "1,2x", 3, { { "1", "2", "" } } });
+	CHECK(Program::compile(list).run("1,2x") == ParserState{ "1,2x", 3, { { "1", "2", "" } } });
+
+	// the analysis looks through lazy rules
+	Parser optionalX;
+	auto optionalRule = Parsers::lazy([&optionalX]() { return optionalX; });
+	optionalX = Parsers::choice(Parsers::str("x"), Parsers::str(""));
+	const auto loop = Parsers::star(optionalRule);
+	const auto loopAnalysis = GrammarAnalysis::analyze(loop);
+	CHECK(loopAnalysis.nullable(optionalRule) == Nullable::Yes);
+	CHECK(warnings(loopAnalysis, Kind::NullableLoop) == std::vector<std::string>{
+		"star: Parser can match without consuming input, the loop never ends" });
+	CHECK(loop.run("xx") == ParserState{ "xx", 2, { { "x", "x" } } });
+
+	Parser expression;
+	auto expressionRule = Parsers::lazy([&expression]() { return expression; });
+	expression = Parsers::traced("expression", Parsers::choice(
+		Parsers::sequenceOf(expressionRule, Parsers::str("+"), Parsers::digits()),
+		Parsers::digits()));
+	CHECK(warnings(GrammarAnalysis::analyze(expression), Kind::LeftRecursion) == std::vector<std::string>{
+		"lazy: Rule expression can call itself without consuming input" });
+
+	// FIRST sets and choices
+	const auto keywords = Parsers::choice(Parsers::str("ab"), Parsers::str("ac"), Parsers::str("b"), Parsers::digits());
+	const auto keywordAnalysis = GrammarAnalysis::analyze(keywords);
+	CHECK(keywordAnalysis.first(keywords).bytes.count() == 2);
+	CHECK(keywordAnalysis.first(keywords).bytes['b']);
+	CHECK(keywordAnalysis.first(keywords).opaque);
+	CHECK(warnings(keywordAnalysis, Kind::Overlap) == std::vector<std::string>{ "choice: Alternatives 1 and 2 can both start with 'a'" });
+	CHECK(warnings(GrammarAnalysis::analyze(Parsers::choice(Parsers::str("a"), Parsers::str("ab"))), Kind::Shadowed)
+		== std::vector<std::string>{ "choice: Alternative 2 \"ab\" never matches after alternative 1 \"a\"" });
+
+	// S <- "a" S "b" / "a" S "c" / "a" parses S again after the first alternative fails
+	Parser exponential;
+	auto rule = Parsers::lazy([&exponential]() { return exponential; });
+	exponential = Parsers::traced("S", Parsers::choice(
+		Parsers::sequenceOf(Parsers::str("a"), rule, Parsers::str("b")),
+		Parsers::sequenceOf(Parsers::str("a"), rule, Parsers::str("c")),
+		Parsers::str("a")));
+	CHECK(warnings(GrammarAnalysis::analyze(exponential), Kind::MemoCandidate) == std::vector<std::string>{
+		"lazy: Rule S is parsed again at the same index after backtracking in 1 choice, memo would keep its results" });
+	Parser memoized;
+	auto memoRule = Parsers::memo(Parsers::lazy([&memoized]() { return memoized; }));
+	memoized = Parsers::choice(
+		Parsers::sequenceOf(Parsers::str("a"), memoRule, Parsers::str("b")),
+		Parsers::sequenceOf(Parsers::str("a"), memoRule, Parsers::str("c")),
+		Parsers::str("a"));
+	CHECK(warnings(GrammarAnalysis::analyze(memoized), Kind::MemoCandidate).empty());
+
+	for (auto format : { Grammars::Format::Json, Grammars::Format::Csv, Grammars::Format::Ini, Grammars::Format::Arithmetic }) {
+		CAPTURE(Grammars::formatName(format));
+		const auto analysis = GrammarAnalysis::analyze(Grammars::grammar(format));
+		CHECK(warnings(analysis, Kind::NullableLoop).empty());
+		CHECK(warnings(analysis, Kind::LeftRecursion).empty());
+	}
+}
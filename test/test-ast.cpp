@@ -0,0 +1,68 @@
+TEST_CASE("ast nodes") {
+	enum Kind : std::uint32_t { Number, Name, Assignment, Array };
+
+	Parser value_parser;
+	auto array_parser = Parsers::astNode(Array, Parsers::between(Parsers::str("["), Parsers::str("]"))(
+		Parsers::sepBy_star(Parsers::str(","))(Parsers::lazy([&value_parser]() { return value_parser; }))));
+	auto name_parser = Parsers::astNode(Name, Parsers::letters());
+	value_parser = Parsers::choice(
+		Parsers::astNode(Number, Parsers::digits()),
+		// adds a Name node before failing without "="
+		Parsers::astNode(Assignment, Parsers::sequenceOf(name_parser, Parsers::str("="), Parsers::digits())),
+		name_parser,
+		array_parser
+	);
+
+	const std::string input = "[1,[ab,c=2],34]";
+	// the plain parser without an Ast
+	CHECK(array_parser.run(input).result.values == std::vector<std::string>{ "1", "ab", "c", "=", "2", "34" });
+
+	Ast ast;
+	RunContext context{ .ast = &ast };
+	auto result = array_parser.run(input, context);
+	REQUIRE(!result.isError);
+	CHECK(result.result.values.empty());
+
+	// children before their parents
+	REQUIRE(ast.nodes.size() == 7);
+	REQUIRE(ast.roots.size() == 1);
+	const auto root = ast.roots[0];
+	CHECK(root == 6);
+	CHECK(ast.nodes[root].kind == Array);
+	CHECK(ast.nodes[root].text(input) == input);
+
+	auto kinds = [&ast](std::uint32_t node) {
+		std::vector<std::uint32_t> kinds;
+		for (auto child : ast.children(node)) {
+			kinds.push_back(ast.nodes[child].kind);
+		}
+		return kinds;
+	};
+	CHECK(kinds(root) == std::vector<std::uint32_t>{ Number, Array, Number });
+	const auto inner = ast.children(root)[1];
+	CHECK(ast.nodes[inner].text(input) == "[ab,c=2]");
+	CHECK(kinds(inner) == std::vector<std::uint32_t>{ Name, Assignment });
+	const auto assignment = ast.children(inner)[1];
+	CHECK(kinds(assignment) == std::vector<std::uint32_t>{ Name });
+	CHECK(ast.nodes[ast.children(assignment)[0]].text(input) == "c");
+	CHECK(ast.nodes[ast.children(root)[2]].text(input) == "34");
+
+	// the machine rolls back the nodes of failed alternatives too
+	Ast programAst;
+	auto programContext = RunContext{ .ast = &programAst };
+	const auto program = Program::compile(array_parser);
+	CHECK(!program.run(input, programContext).isError);
+	CHECK(programAst.nodes == ast.nodes);
+	CHECK(programAst.roots == ast.roots);
+
+	// plus counts matches, not values
+	Ast numbers;
+	context = RunContext{ .ast = &numbers };
+	auto numbers_parser = Parsers::plus(Parsers::sequenceOf(Parsers::astNode(Number, Parsers::digits()), Parsers::str(";")));
+	CHECK(!numbers_parser.run("1;2;x", context).isError);
+	CHECK(numbers.roots == std::vector<std::uint32_t>{ 0, 1 });
+	Ast programNumbers;
+	context = RunContext{ .ast = &programNumbers };
+	CHECK(Program::compile(Parsers::plus(Parsers::astNode(Number, Parsers::digits()))).run("12", context).index == 2);
+	CHECK(programNumbers.nodes.size() == 1);
+}
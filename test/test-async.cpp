@@ -0,0 +1,134 @@
+// chunks of input, every read is ready
+struct ChunkSource
+{
+	std::vector<std::string> chunks;
+	std::size_t next = 0;
+
+	auto read() {
+		struct awaiter {
+			std::string_view chunk;
+			bool await_ready() const noexcept { return true; }
+			void await_suspend(std::coroutine_handle<>) const noexcept {}
+			std::string_view await_resume() const noexcept { return chunk; }
+		};
+		return awaiter{ next < chunks.size() ? std::string_view(chunks[next++]) : std::string_view{} };
+	}
+};
+
+TEST_CASE("async parse from chunks") {
+	auto parser = Parsers::sequenceOf({
+		Parsers::str("GET "),
+		Parsers::letters(),
+		Parsers::str(" "),
+		Parsers::sepBy_plus(Parsers::str(","))(Parsers::digits()),
+		Parsers::str(";")
+	});
+	// one byte at a time
+	ChunkSource source;
+	for (auto c : std::string_view("GET abc 1,23,456;")) {
+		source.chunks.push_back(std::string(1, c));
+	}
+	auto task = parser.runAsync(source);
+	task.start();
+	REQUIRE(task.done());
+	auto result = task.result();
+	CHECK(!result.isError);
+	CHECK(result.index == 17);
+	CHECK(result.result == ParseResult{ {"GET ", "abc", " ", "1", "23", "456", ";"} });
+	// error in the middle of the input
+	source = ChunkSource{ { "GET ab", "c 1,2x", "3;" } };
+	task = parser.runAsync(source);
+	task.start();
+	REQUIRE(task.done());
+	result = task.result();
+	CHECK(result.isError);
+	CHECK(result.error == "Expected \",\" or \";\" at index 11");
+	CHECK(source.next == 2);
+}
+
+#ifndef _WIN32
+TEST_CASE("async parse from sockets") {
+	auto parser = Parsers::sequenceOf({
+		Parsers::str("SET "),
+		Parsers::letters(),
+		Parsers::str("="),
+		Parsers::digits(),
+		Parsers::str(";")
+	});
+	auto program = Program::compile(parser);
+
+	constexpr int connections = 200;
+	EventLoop loop;
+	std::vector<std::array<int, 2>> sockets(connections);
+	std::vector<FdSource> sources;
+	std::vector<Task<ParserState>> tasks;
+	sources.reserve(connections);
+	for (auto& pair : sockets) {
+		REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM, 0, pair.data()) == 0);
+		sources.emplace_back(loop, pair[0]);
+	}
+	for (auto& source : sources) {
+		tasks.push_back(program.runAsync(source));
+		tasks.back().start();
+	}
+	CHECK(loop.waiting() == connections);
+	// first half of every message, all parses wait for more
+	for (int i = 0; i < connections; ++i) {
+		const auto half = std::format("SET key{}", std::string(i % 3, 'x'));
+		CHECK(::write(sockets[i][1], half.data(), half.size()) == static_cast<ssize_t>(half.size()));
+	}
+	while (loop.poll(0) > 0) {
+	}
+	CHECK(loop.waiting() == connections);
+	CHECK(std::ranges::none_of(tasks, [](auto& task) { return task.done(); }));
+	// the rest and the end of input
+	for (int i = 0; i < connections; ++i) {
+		const auto rest = std::format("={};", i);
+		CHECK(::write(sockets[i][1], rest.data(), rest.size()) == static_cast<ssize_t>(rest.size()));
+		::close(sockets[i][1]);
+	}
+	loop.run();
+	for (int i = 0; i < connections; ++i) {
+		REQUIRE(tasks[i].done());
+		const auto result = tasks[i].result();
+		CHECK(result.result == ParseResult{ {"SET ", std::format("key{}", std::string(i % 3, 'x')), "=", std::format("{}", i), ";"} });
+		::close(sockets[i][0]);
+	}
+}
+
+TEST_CASE("async read wakeups and errors") {
+	auto program = Program::compile(Parsers::plus(Parsers::str("a")));
+	EventLoop loop;
+	int fds[2];
+	REQUIRE(::pipe(fds) == 0);
+	// two readers of one pipe are both woken by one byte, the one which finds no data waits again
+	FdSource first(loop, fds[0]);
+	FdSource second(loop, fds[0]);
+	auto firstTask = program.runAsync(first);
+	auto secondTask = program.runAsync(second);
+	firstTask.start();
+	secondTask.start();
+	CHECK(::write(fds[1], "a", 1) == 1);
+	CHECK(loop.poll(-1) == 2);
+	CHECK(loop.waiting() == 2);
+	CHECK(!firstTask.done());
+	CHECK(!secondTask.done());
+	::close(fds[1]);
+	loop.run();
+	const auto firstResult = firstTask.result();
+	const auto secondResult = secondTask.result();
+	CHECK(firstResult.result.values.size() + secondResult.result.values.size() == 1);
+	CHECK(firstResult.isError != secondResult.isError);
+	::close(fds[0]);
+
+	// a read error isn't the end of input
+	REQUIRE(::pipe(fds) == 0);
+	FdSource writeEnd(loop, fds[1]);
+	auto failed = program.runAsync(writeEnd);
+	failed.start();
+	REQUIRE(failed.done());
+	CHECK_THROWS_AS(failed.result(), std::system_error);
+	::close(fds[0]);
+	::close(fds[1]);
+}
+#endif
@@ -0,0 +1,68 @@
+TEST_CASE("binary primitives") {
+	using namespace std::string_literals;
+	// fixed width integers
+	CHECK(Parsers::integer(2, std::endian::big).run("\x01\x02"s) == ParserState{ "\x01\x02"s, 2, { { "258" } } });
+	CHECK(Parsers::integer(2).run("\x01\x02"s).result.values == std::vector<std::string>{ "513" });
+	CHECK(Parsers::integer(3, std::endian::big).run("\x01\x00\x00"s).result.values == std::vector<std::string>{ "65536" });
+	CHECK(Parsers::integer(4, std::endian::little, true).run("\xff\xff\xff\xff"s).result.values == std::vector<std::string>{ "-1" });
+	CHECK(Parsers::integer(1, std::endian::little, true).run("\x80"s).result.values == std::vector<std::string>{ "-128" });
+	CHECK(Parsers::integer(8, std::endian::big).run("\x00\x00\x00\x01\x00\x00\x00\x00x"s)
+		== ParserState{ "\x00\x00\x00\x01\x00\x00\x00\x00x"s, 8, { { "4294967296" } } });
+	CHECK(Parsers::integer(4).run("ab") == ParserState{ "ab", 0, {}, true, "Expected uint32le at index 0" });
+	CHECK_THROWS_AS(Parsers::integer(9), std::invalid_argument);
+
+	// varints
+	CHECK(Parsers::varint().run("\xac\x02"s) == ParserState{ "\xac\x02"s, 2, { { "300" } } });
+	CHECK(Parsers::varint(true).run("\x03"s).result.values == std::vector<std::string>{ "-2" });
+	CHECK(Parsers::varint().run("\xff\xff\xff\xff\xff\xff\xff\xff\xff\x01"s).result.values
+		== std::vector<std::string>{ "18446744073709551615" });
+	CHECK(Parsers::varint().run("\x80"s).error == "Expected varint at index 0");
+	CHECK(Parsers::varint().run("\xff\xff\xff\xff\xff\xff\xff\xff\xff\x02"s).error == "Expected varint at index 0");
+
+	// byte spans and length prefixed fields
+	CHECK(Parsers::take(3).run("abcdef") == ParserState{ "abcdef", 3, { { "abc" } } });
+	CHECK(Parsers::take(3).run("ab").error == "Expected take 3 at index 0");
+	auto field = Parsers::lengthPrefixed(Parsers::integer(1), Parsers::sequenceOf(Parsers::str("ab"), Parsers::take(1)));
+	CHECK(field.run("\x03" "abcX") == ParserState{ "\x03" "abcX", 4, { { "ab", "c" } } });
+	CHECK(Parsers::lengthPrefixed(Parsers::integer(1), Parsers::str("ab")).run("\x03" "abc").error
+		== "lengthPrefixed: Body ended at index 3 before the end of the field at index 4");
+	// the body can't look past the field
+	CHECK(Parsers::lengthPrefixed(Parsers::integer(1), Parsers::str("abc")).run("\x02" "abc").error
+		== "Expected \"abc\" at index 1");
+	CHECK(Parsers::lengthPrefixed(Parsers::integer(1)).run("\x05" "ab").error
+		== "lengthPrefixed: Length 5 past the end of the input at index 1");
+
+	// frames of a 2 byte big endian length and a body
+	const auto frames = Parsers::plus(Parsers::lengthPrefixed(Parsers::integer(2, std::endian::big)));
+	const auto input = "\x00\x02hi\x00\x00\x00\x05hello"s;
+	CHECK(frames.run(input) == ParserState{ input, input.length(), { { "hi", "", "hello" } } });
+	CHECK(Program::compile(frames).run(input) == frames.run(input));
+	CHECK(Parsers::lengthPrefixed(Parsers::varint()).run("\x02hiX"s) == ParserState{ "\x02hiX"s, 3, { { "hi" } } });
+
+	// sink mode reports spans instead of copies
+	std::vector<SinkEvent> events;
+	ParseSink sink{ [&events](const SinkEvent& event) { events.push_back(event); } };
+	RunContext context{ .sink = &sink };
+	CHECK(Parsers::lengthPrefixed(Parsers::integer(1), Parsers::take(2)).run("\x02xy"s, context) == ParserState{ "\x02xy"s, 3, {} });
+	CHECK(events == std::vector<SinkEvent>{
+		SinkEvent{ SinkEvent::Kind::Token, FurthestFailure::itemId("length"), 0, 1 },
+		SinkEvent{ SinkEvent::Kind::Token, FurthestFailure::itemId("take 2"), 1, 3 } });
+
+	// grammar nodes for the analysis and the loop checks
+	CHECK(nullable(Parsers::integer(2)) == Nullable::No);
+	CHECK(nullable(Parsers::varint()) == Nullable::No);
+	CHECK(nullable(Parsers::take(0)) == Nullable::Yes);
+	CHECK(nullable(Parsers::lengthPrefixed(Parsers::integer(1))) == Nullable::No);
+	CHECK(nullable(Parsers::lengthPrefixed(Parsers::succeed({ { "0" } }))) == Nullable::Unknown);
+	CHECK_THROWS_AS(Parsers::star(Parsers::take(0)), std::invalid_argument);
+	CHECK(GrammarAnalysis::analyze(frames).first(frames).bytes.all());
+
+	// a memo rule of a body doesn't keep its result of the shorter input
+	const auto letters = Parsers::memo(Parsers::plus(Parsers::str("a")));
+	const auto header = Parsers::choice(
+		Parsers::sequenceOf(Parsers::lengthPrefixed(Parsers::integer(1), letters), Parsers::str("!")),
+		Parsers::sequenceOf(Parsers::integer(1), letters));
+	MemoTable memo;
+	RunContext memoContext{ .memo = &memo };
+	CHECK(header.run("\x01" "aaa"s, memoContext) == ParserState{ "\x01" "aaa"s, 4, { { "1", "a", "a", "a" } } });
+}
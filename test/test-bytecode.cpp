@@ -0,0 +1,120 @@
+TEST_CASE("bytecode program") {
+	auto brackets_parser = Parsers::between(
+		Parsers::str("["), Parsers::str("]"));
+	auto comma_parser = Parsers::sepBy_star(Parsers::str(","));
+
+	Parser array_parser;
+	auto value_parser = Parsers::lazy([&array_parser]() {
+		return Parsers::choice(
+			Parsers::digits(),
+			Parsers::plus(Parsers::choice(Parsers::str("a"), Parsers::str("b"))),
+			array_parser
+		);
+	});
+	array_parser = brackets_parser(comma_parser(value_parser));
+
+	auto program = Program::compile(array_parser);
+	// same results as the closure parser
+	for (auto input : { "[1,[2,[3],4],5]", "[]", "[1,ab,[ba]]", "[1,2,]" }) {
+		CHECK(program.run(input) == array_parser.run(input));
+	}
+	// errors name the furthest failure
+	CHECK(program.run("[1,").error == "Expected digits, \"a\", \"b\", \"[\" or \"]\" at index 3");
+	CHECK(program.run("(1)").error == "Expected \"[\" at index 0");
+	CHECK(program.run("").error == "Expected \"[\" at index 0");
+	auto result = program.run("[1,[2,[3],4],5]");
+	CHECK(result == ParserState{
+		"[1,[2,[3],4],5]", 15, { {"1", "2", "3", "4", "5"} }
+	});
+
+	// closures run as escapes
+	auto plus_parser = Parsers::plus(Parsers::sequenceOf({
+		Parsers::letters().map([](const ParseResult& result) -> ParseResult {
+			return { { std::format("<{}>", result.values[0]) } };
+		}),
+		Parsers::sepBy_plus(Parsers::str(" "))(Parsers::digits())
+	}));
+	program = Program::compile(plus_parser);
+	CHECK(program.run("ab1 2cd3") == plus_parser.run("ab1 2cd3"));
+	CHECK(program.run("ab").error == "Expected digits at index 2");
+	CHECK(program.run("12").error == "Expected letters at index 0");
+	result = program.run("ab1 2cd3");
+	CHECK(result == ParserState{
+		"ab1 2cd3", 8, { {"<ab>", "1", "2", "<cd>", "3"} }
+	});
+
+	// bounded stack instead of native recursion
+	program = Program::compile(array_parser, 64);
+	result = program.run(std::string(100, '[') + std::string(100, ']'));
+	CHECK(result.isError);
+	CHECK(result.error.starts_with("vm: Stack limit 64 reached"));
+}
+
+TEST_CASE("deep nesting") {
+	auto brackets_parser = Parsers::between(
+		Parsers::str("["), Parsers::str("]"));
+	auto comma_parser = Parsers::sepBy_star(Parsers::str(","));
+
+	Parser array_parser;
+	auto value_parser = Parsers::lazy([&array_parser]() {
+		return Parsers::choice(
+			Parsers::digits(),
+			array_parser
+		);
+	});
+	array_parser = brackets_parser(comma_parser(value_parser)).map([](const ParseResult& result) -> ParseResult {
+		return { { std::format("{}", result.values.size()) } };
+	});
+	const auto deep = std::string(100000, '[') + "1" + std::string(100000, ']');
+
+	// closure parsers stop at the depth guard, with the error of the guard
+	RunContext context;
+	context.maxDepth = 100;
+	auto result = array_parser.run(deep, context);
+	CHECK(result == ParserState{
+		deep, 101, {}, true, "lazy: Maximum nesting depth 100 reached at index 101"
+	});
+#ifndef _WIN32
+	// the default guard stops the closure parser on a thread with a small stack
+	struct SmallStackRun
+	{
+		const Parser& parser;
+		const std::string& input;
+		ParserState result{};
+	} smallStackRun{ array_parser, deep };
+	pthread_attr_t attributes;
+	pthread_attr_init(&attributes);
+	pthread_attr_setstacksize(&attributes, 1 << 20);
+	pthread_t thread;
+	REQUIRE(pthread_create(&thread, &attributes, [](void* argument) -> void* {
+		auto& run = *static_cast<SmallStackRun*>(argument);
+		run.result = run.parser.run(run.input);
+		return nullptr;
+	}, &smallStackRun) == 0);
+	pthread_join(thread, nullptr);
+	pthread_attr_destroy(&attributes);
+	CHECK(smallStackRun.result == ParserState{
+		deep, 257, {}, true, "lazy: Maximum nesting depth 256 reached at index 257"
+	});
+#endif
+	result = array_parser.run("[[[1],2],[3]]", context = RunContext{ .maxDepth = 100 });
+	CHECK(result == ParserState{
+		"[[[1],2],[3]]", 13, { {"2"} }
+	});
+
+	// the bytecode machine nests on its heap stack, maps included
+	auto program = Program::compile(array_parser);
+	CHECK(program.run("[[[1],2],[3]]") == array_parser.run("[[[1],2],[3]]"));
+	result = program.run(deep);
+	CHECK(result == ParserState{
+		deep, 200001, { {"1"} }
+	});
+
+	// a deep input which fails reports the syntax error, not the depth guard of the closure parser
+	const auto unclosed = std::string(100000, '[') + "1" + std::string(99999, ']');
+	result = program.run(unclosed, context = RunContext{ .maxDepth = 1000 });
+	CHECK(result == ParserState{
+		unclosed, 200000, {}, true, "Expected \",\" or \"]\" at index 200000"
+	});
+	CHECK(program.run(unclosed) == result);
+}
@@ -0,0 +1,41 @@
+TEST_CASE("reference grammars") {
+	using Grammars::Format;
+	auto json = Grammars::json().run(" {\"a\": [1, -2.5e3, true, null, {}], \"b\\\"\": \"x\\u00e9\" } ");
+	REQUIRE(!json.isError);
+	CHECK(json.result.values == std::vector<std::string>{ "\"a\"", "1", "-2.5e3", "true", "null", "\"b\\\"\"", "\"x\\u00e9\"" });
+	CHECK(Grammars::json().run("[1, 2,]").isError);
+	CHECK(Grammars::json().run("[01]").isError);
+
+	auto csv = Grammars::csv().run("a,\"b,\"\"c\"\"\",\r\n,x\n");
+	CHECK(csv.result.values == std::vector<std::string>{ "a", "\"b,\"\"c\"\"\"", "", "", "x" });
+
+	auto ini = Grammars::ini().run("; settings\n[server]\n  host = example.org \n\nport=80\n# end");
+	CHECK(ini.result.values == std::vector<std::string>{ "server", "host", "example.org ", "port", "80" });
+	CHECK(Grammars::ini().run("[server\n").isError);
+
+	auto arithmetic = Grammars::arithmetic().run("1 + 2 * 3\n-(4 - 6) / 4\n2 - -1.5\n");
+	CHECK(arithmetic.result.values == std::vector<std::string>{ "7", "0.5", "3.5" });
+	CHECK(Grammars::arithmetic().run("1 +\n").isError);
+	CHECK(Grammars::baseline(Format::Json, "[1, 2,]").isError);
+	CHECK(Grammars::baseline(Format::Csv, "a,\"b").isError);
+	CHECK(Grammars::baseline(Format::Ini, "[server\n").isError);
+	CHECK(Grammars::baseline(Format::Arithmetic, "1 +\n").isError);
+
+	// the closure parser, the machine and the hand-written baseline agree on generated input
+	for (auto format : { Format::Json, Format::Csv, Format::Ini, Format::Arithmetic }) {
+		CAPTURE(Grammars::formatName(format));
+		CHECK(Grammars::parseFormatName(Grammars::formatName(format)) == format);
+		const auto input = Grammars::corpus(format, 1 << 14, 7);
+		CHECK(input.length() >= 1 << 14);
+		CHECK(input == Grammars::corpus(format, 1 << 14, 7));
+		const auto expected = Grammars::baseline(format, input);
+		REQUIRE(!expected.isError);
+		CHECK(expected.index == input.length());
+		const auto result = Grammars::grammar(format).run(input);
+		CHECK(!result.isError);
+		CHECK(result.index == expected.index);
+		CHECK(result.result == expected.result);
+		CHECK(Program::compile(Grammars::grammar(format)).run(input).result == expected.result);
+	}
+	CHECK(!Grammars::parseFormatName("xml"));
+}
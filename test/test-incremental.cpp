@@ -0,0 +1,84 @@
+TEST_CASE("incremental reparse") {
+	int digitsCalls = 0;
+	auto number_parser = Parsers::digits().map([&digitsCalls](const ParseResult& result) -> ParseResult {
+		++digitsCalls;
+		return result;
+	});
+	auto brackets_parser = Parsers::between(
+		Parsers::str("["), Parsers::str("]"));
+	auto comma_parser = Parsers::sepBy_star(Parsers::str(","));
+
+	Parser array_parser;
+	auto value_parser = Parsers::memo(Parsers::lazy([&]() {
+		return Parsers::choice(
+			number_parser,
+			array_parser
+		);
+	}));
+	array_parser = brackets_parser(comma_parser(value_parser));
+
+	IncrementalParser parser(array_parser, "[1,[2,3],4,5]");
+	auto result = parser.parse();
+	CHECK(result == ParserState{
+		"[1,[2,3],4,5]", 13, { {"1", "2", "3", "4", "5"} }
+	});
+	CHECK(digitsCalls == 5);
+	// only the edited value is parsed again
+	digitsCalls = 0;
+	result = parser.edit(9, 1, "42");
+	CHECK(result == ParserState{
+		"[1,[2,3],42,5]", 14, { {"1", "2", "3", "42", "5"} }
+	});
+	CHECK(digitsCalls == 1);
+	CHECK(result == array_parser.run(parser.text()));
+	// removed value
+	result = parser.edit(1, 2, "");
+	CHECK(result == ParserState{
+		"[[2,3],42,5]", 12, { {"2", "3", "42", "5"} }
+	});
+	CHECK(result == array_parser.run(parser.text()));
+	// broken input
+	result = parser.edit(0, 1, "(");
+	CHECK(result.isError);
+	CHECK(result == array_parser.run(parser.text()));
+
+	// edits before and after the previous one, with shifted results on both sides
+	parser.edit(0, 1, "[");
+	for (auto [offset, removed, inserted] : std::vector<std::tuple<std::size_t, std::size_t, std::string>>{
+		{ 9, 0, ",[7,8]" }, { 2, 1, "33" }, { 12, 3, "" }, { 1, 0, "9," }, { 16, 1, "0" }, { 3, 6, "7" } }) {
+		result = parser.edit(offset, removed, inserted);
+		CHECK(result == array_parser.run(parser.text()));
+	}
+	CHECK(parser.text() == "[9,7,42,[],0]");
+
+	// a remembered result adds what the rule expected to the failure of the run
+	MemoTable memo;
+	RunContext context{ .memo = &memo };
+	const auto failed = array_parser.run("[1,[2,x]]", context);
+	CHECK(failed.error == "Expected digits, \"[\" or \"]\" at index 6");
+	CHECK(array_parser.run("[1,[2,x]]", context) == failed);
+
+	// a large document: an edit parses the edited value again and the rules around it, not the document
+	std::string document = "[";
+	for (int i = 0; i < 2000; ++i) {
+		document += i == 0 ? "[1,2,3,4,5,6,7,8,9]" : ",[1,2,3,4,5,6,7,8,9]";
+	}
+	document += "]";
+	IncrementalParser large(array_parser, document);
+	CHECK(!large.parse().isError);
+	const auto entries = large.memo().size();
+	for (std::size_t offset : { document.length() / 2, document.length() / 2 + 20, document.length() / 3 }) {
+		offset = document.find_first_of("123456789", offset);
+		digitsCalls = 0;
+		result = large.edit(offset, 1, "7");
+		CHECK(!result.isError);
+		CHECK(result.index == document.length());
+		CHECK(digitsCalls == 1);
+		CHECK(large.memo().size() == entries);
+	}
+	CHECK(result == array_parser.run(large.text()));
+	// the values of remembered rules are shared with the memo table, not copied into the result
+	CHECK(!result.result.parts.empty());
+	CHECK(result.result.flattened().values.size() == 18000);
+	CHECK(array_parser.run(large.text()).result.parts.empty());
+}
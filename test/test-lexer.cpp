@@ -0,0 +1,63 @@
+TEST_CASE("lexer tokenize") {
+	Lexer lexer;
+	auto let = lexer.str("let");
+	auto number = lexer.regexp(std::regex("\\d+"), "number");
+	auto word = lexer.regexp(std::regex("[a-z]+"), "word");
+	auto comma = lexer.str(",");
+	lexer.skip(std::regex("\\s+"));
+	CHECK_THROWS_AS(lexer.str(""), std::invalid_argument);
+	// success
+	auto stream = lexer.tokenize("12, ab ,let letter");
+	CHECK(!stream.isError);
+	CHECK(stream.tokens == std::vector<Token>{
+		{ number, 0, 2 }, { comma, 2, 1 }, { word, 4, 2 }, { comma, 7, 1 }, { let, 8, 3 }, { word, 12, 6 }
+	});
+	// fail
+	stream = lexer.tokenize("12 ?");
+	CHECK(stream.isError);
+	CHECK(stream.error == "lexer: Couldn't match any token at index 3");
+}
+
+TEST_CASE("token parsers") {
+	Lexer lexer;
+	auto number = lexer.regexp(std::regex("\\d+"), "number");
+	auto word = lexer.regexp(std::regex("[a-z]+"), "word");
+	auto comma = lexer.str(",");
+	auto open = lexer.str("[");
+	auto close = lexer.str("]");
+	lexer.skip(std::regex("\\s+"));
+
+	auto brackets_parser = Parsers::between(lexer.token(open), lexer.token(close));
+	auto comma_parser = Parsers::sepBy_star(lexer.token(comma));
+	auto parser = brackets_parser(comma_parser(Parsers::choice(
+		lexer.token(word),
+		lexer.token(number)
+	)));
+	// success
+	auto result = parser.run(lexer.tokenize("[1, ab, 3]"));
+	CHECK(result == ParserState{
+		"[1, ab, 3]", 7, { {"1", "ab", "3"} }
+	});
+	// fail
+	result = parser.run(lexer.tokenize("[1, 2"));
+	CHECK(result == ParserState{
+		"[1, 2", 4, {}, true, "Expected \",\" or \"]\" at index 5"
+	});
+	result = parser.run(lexer.tokenize("(1)"));
+	CHECK(result == ParserState{
+		"(1)", 0, {}, true, "lexer: Couldn't match any token at index 0"
+	});
+}
+
+TEST_CASE("token furthest failure") {
+	Lexer lexer;
+	auto number = lexer.regexp(std::regex("\\d+"), "number");
+	auto plus = lexer.str("+");
+	lexer.skip(std::regex("\\s+"));
+
+	auto parser = Parsers::sequenceOf({ lexer.token(number), lexer.token(plus), lexer.token(number) });
+	RunContext context;
+	auto result = parser.run(lexer.tokenize("1 + +"), context);
+	CHECK(result.isError);
+	CHECK(context.failure.message() == "Expected number at index 4");
+}
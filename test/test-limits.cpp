@@ -0,0 +1,57 @@
+TEST_CASE("run limits") {
+	// S <- "a" S "b" / "a" S "c" / "a", exponential on a run of "a"
+	Parser exponential;
+	auto rule = Parsers::lazy([&exponential]() { return exponential; });
+	exponential = Parsers::choice(
+		Parsers::sequenceOf(Parsers::str("a"), rule, Parsers::str("b")),
+		Parsers::sequenceOf(Parsers::str("a"), rule, Parsers::str("c")),
+		Parsers::str("a"));
+	const std::string hostile(40, 'a');
+
+	// steps are counted in loop iterations
+	auto words = Parsers::star(Parsers::sequenceOf(Parsers::letters(), Parsers::str(" ")));
+	RunContext stepContext{ .maxSteps = 3 };
+	CHECK(words.run("a b c d ", stepContext) == ParserState{ "a b c d ", 6, {}, true, "limit: Step limit 3 reached at index 6" });
+	CHECK(stepContext.limit == RunLimit::Steps);
+	RunContext enoughContext{ .maxSteps = 5 };
+	CHECK(!words.run("a b c d ", enoughContext).isError);
+	CHECK(enoughContext.limit == RunLimit::None);
+
+	// and in lazy calls, the run stops at the first limit reached
+	RunContext exponentialContext{ .maxSteps = 10000 };
+	const auto stopped = exponential.run(hostile, exponentialContext);
+	CHECK(stopped.isError);
+	CHECK(stopped.error.starts_with("limit: Step limit 10000 reached at index "));
+	CHECK(exponentialContext.steps == 10001);
+	RunContext programContext{ .maxSteps = 10000 };
+	CHECK(Program::compile(exponential).run(hostile, programContext).error.starts_with("limit: Step limit 10000 reached"));
+	CHECK(programContext.limit == RunLimit::Steps);
+
+	// a context is reused, the next run starts without the abort, steps and failure of the last one
+	const auto ab = Parsers::choice({ Parsers::str("a"), Parsers::str("b") });
+	CHECK(ab.run("b", exponentialContext) == ParserState{ "b", 1, { {"b"} } });
+	CHECK(exponentialContext.limit == RunLimit::None);
+	CHECK(exponentialContext.steps == 0);
+	CHECK(ab.run("c", exponentialContext).error == "Expected \"a\" or \"b\" at index 0");
+	CHECK(exponentialContext.failure.message() == "Expected \"a\" or \"b\" at index 0");
+	CHECK(Program::compile(ab).run("b", programContext) == ParserState{ "b", 1, { {"b"} } });
+	CHECK(programContext.limit == RunLimit::None);
+
+	RunContext deadlineContext{ .deadline = std::chrono::steady_clock::now() };
+	CHECK(exponential.run(hostile, deadlineContext) == ParserState{ hostile, 1, {}, true, "limit: Deadline passed at index 1" });
+	CHECK(deadlineContext.limit == RunLimit::Deadline);
+
+	// cancelled from another thread
+	RunContext cancelledContext;
+	ParserState cancelled;
+	{
+		std::jthread worker([&](std::stop_token stop) {
+			cancelledContext.stop = stop;
+			cancelled = exponential.run(hostile, cancelledContext);
+		});
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	}
+	CHECK(cancelled.isError);
+	CHECK(cancelled.error.starts_with("limit: Run cancelled at index "));
+	CHECK(cancelledContext.limit == RunLimit::Cancelled);
+}
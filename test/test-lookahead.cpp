@@ -0,0 +1,70 @@
+TEST_CASE("lookahead") {
+	// identifiers which aren't the keyword "if"
+	const auto keyword = Parsers::sequenceOf(Parsers::str("if"), Parsers::notFollowedBy(Parsers::letters()));
+	const auto identifier = Parsers::sequenceOf(Parsers::notFollowedBy(keyword), Parsers::letters());
+	CHECK(identifier.run("iffy") == ParserState{ "iffy", 4, { { "iffy" } } });
+	CHECK(identifier.run("if x") == ParserState{ "if x", 0, {}, true, "notFollowedBy: Parser matched at index 0" });
+	CHECK(Parsers::sequenceOf(Parsers::peek(Parsers::str("ab")), Parsers::letters()).run("abc") == ParserState{ "abc", 3, { { "abc" } } });
+	CHECK(Parsers::peek(Parsers::str("ab")).run("xy") == ParserState{ "xy", 0, {}, true, "peek: Parser didn't match at index 0" });
+
+	// the span of the match as one value
+	const auto number = Parsers::recognize(Parsers::sequenceOf(Parsers::digits(), Parsers::str("."), Parsers::digits()));
+	CHECK(number.run("3.14x") == ParserState{ "3.14x", 4, { { "3.14" } } });
+	CHECK(number.run("3x").error == "recognize: Parser didn't match at index 0");
+	// chain gets the values of its parser, map isn't called
+	const auto twice = Parsers::recognize(Parsers::letters().chain([](const ParseResult& result) {
+		return Parsers::sequenceOf(Parsers::str("-"), Parsers::str(result.values[0]));
+	}));
+	CHECK(twice.run("ab-abx") == ParserState{ "ab-abx", 5, { { "ab-ab" } } });
+	int maps = 0;
+	const auto counted = Parsers::str("a").map([&maps](const ParseResult& result) { ++maps; return result; });
+	CHECK(Parsers::recognize(Parsers::plus(counted)).run("aa") == ParserState{ "aa", 2, { { "aa" } } });
+	CHECK(maps == 0);
+	CHECK(Program::compile(Parsers::sequenceOf(number, Parsers::str("!"))).run("1.5!") == ParserState{ "1.5!", 4, { { "1.5", "!" } } });
+
+	// failed alternatives inside the lookahead format no messages
+	const auto alternatives = Parsers::choice(Parsers::str("a"), Parsers::str("b"), Parsers::str("c"));
+	RunStats stats;
+	RunContext context{ .stats = &stats };
+	CHECK(!Parsers::peek(alternatives).run("c", context).isError);
+	CHECK(stats.errors == 0);
+	CHECK(stats.backtracks == 2);
+	RunStats plainStats;
+	RunContext plainContext{ .stats = &plainStats };
+	CHECK(!alternatives.run("c", plainContext).isError);
+	CHECK(plainStats.errors == 2);
+
+	// a whole run in recognition mode, aborted errors keep their messages
+	const auto json = Grammars::grammar(Grammars::Format::Json);
+	const std::string document = R"({"a": [1, 2.5, "x"], "b": null})";
+	RunContext recognizing{ .recognizing = true };
+	CHECK(json.run(document, recognizing) == ParserState{ document, document.length(), {} });
+	RunContext limited{ .recognizing = true, .maxSteps = 2 };
+	CHECK(json.run(document, limited).error.starts_with("limit: Step limit 2 reached"));
+
+	// memo entries of recognition mode serve the lookaheads, the match with values parses again
+	std::size_t numberCalls = 0;
+	const auto digits = Parsers::digits();
+	const auto memoNumber = Parsers::memo(Parser{ [&numberCalls, digits](const ParserState& state) {
+		++numberCalls;
+		return digits.transformerFn(state);
+	} });
+	MemoTable memo;
+	RunContext memoContext{ .memo = &memo };
+	CHECK(Parsers::sequenceOf(Parsers::peek(memoNumber), Parsers::peek(memoNumber), memoNumber).run("12", memoContext)
+		== ParserState{ "12", 2, { { "12" } } });
+	CHECK(numberCalls == 2);
+	CHECK(Parsers::peek(memoNumber).run("12", memoContext) == ParserState{ "12", 0, {} });
+	CHECK(numberCalls == 2);
+
+	// predicates can't consume input, loops over them are rejected
+	CHECK(nullable(Parsers::peek(Parsers::str("a"))) == Nullable::Yes);
+	CHECK_THROWS_AS(Parsers::star(Parsers::notFollowedBy(Parsers::str("a"))), std::invalid_argument);
+
+	// token runs recognize the source text of the tokens
+	Lexer lexer;
+	auto word = lexer.regexp(std::regex("[a-z]+"), "word");
+	lexer.skip(std::regex("\\s+"));
+	const auto stream = lexer.tokenize("ab  cd ef");
+	CHECK(Parsers::recognize(Parsers::plus(lexer.token(word))).run(stream) == ParserState{ "ab  cd ef", 3, { { "ab  cd ef" } } });
+}
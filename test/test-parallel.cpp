@@ -0,0 +1,91 @@
+TEST_CASE("parallel lists") {
+	auto brackets_parser = Parsers::between(
+		Parsers::str("["), Parsers::str("]"));
+	auto comma_parser = Parsers::sepBy_star(Parsers::str(","));
+
+	Parser array_parser;
+	auto value_parser = Parsers::lazy([&array_parser]() {
+		return Parsers::choice(
+			Parsers::digits(),
+			Parsers::regexp(std::regex("\"[^\"]*\""), "string", 0),
+			array_parser
+		);
+	});
+	array_parser = brackets_parser(comma_parser(value_parser));
+	const ParallelOptions options{ .threads = 4, .minElements = 16, .minBytes = 0 };
+	auto parallel_parser = brackets_parser(Parsers::parallel(comma_parser(value_parser), options));
+
+	std::string document = "[";
+	for (int i = 0; i < 1000; ++i) {
+		document += i % 3 == 0 ? std::format("[{},[{}]],", i, i + 1) : i % 3 == 1 ? std::format("\"a,]{}\",", i) : std::format("{},", i);
+	}
+	document += "0]";
+	const auto expected = array_parser.run(document);
+	REQUIRE(!expected.isError);
+	CHECK(expected.result.values.size() == 1335);
+	CHECK(parallel_parser.run(document) == expected);
+
+	// the workers count, trace and record failures for the run, in its modes
+	RunStats sequentialStats;
+	RunStats parallelStats;
+	TraceBuffer sequentialTrace;
+	TraceBuffer parallelTrace;
+	RunContext sequentialContext{ .stats = &sequentialStats, .trace = &sequentialTrace };
+	RunContext parallelContext{ .stats = &parallelStats, .trace = &parallelTrace };
+	auto traced_parser = brackets_parser(comma_parser(Parsers::traced("value", value_parser)));
+	auto traced_parallel = brackets_parser(Parsers::parallel(comma_parser(Parsers::traced("value", value_parser)), options));
+	CHECK(traced_parallel.run(document, parallelContext) == traced_parser.run(document, sequentialContext));
+	// the scan finds the 1000 separators instead of str
+	CHECK(parallelStats.invocations + 1000 == sequentialStats.invocations);
+	CHECK(parallelStats.backtracks == sequentialStats.backtracks);
+	CHECK(parallelTrace.events().size() == sequentialTrace.events().size());
+	CHECK(parallelContext.failure.message() == sequentialContext.failure.message());
+#ifdef COMBINATORS_COUNT_ALLOCATIONS
+	// the values built on the workers count too, the caller alone parses about a quarter
+	CHECK(parallelStats.allocations * 2 > sequentialStats.allocations);
+#endif
+	// the step budget holds for the workers, a run which needs more steps than it has ends at the limit
+	RunContext counted;
+	REQUIRE(!array_parser.run(document, counted).isError);
+	RunContext enough{ .maxSteps = counted.steps };
+	CHECK(parallel_parser.run(document, enough) == expected);
+	RunContext limited{ .maxSteps = counted.steps / 2 };
+	CHECK(parallel_parser.run(document, limited).error.starts_with(std::format("limit: Step limit {} reached", counted.steps / 2)));
+	CHECK(limited.limit == RunLimit::Steps);
+
+	// a list parsed sequentially after the workers counts and traces its elements once
+	RunStats fallbackStats;
+	TraceBuffer fallbackTrace;
+	RunStats sequentialFallbackStats;
+	TraceBuffer sequentialFallbackTrace;
+	const auto trailing = document.substr(0, document.length() - 1) + ",]";
+	RunContext fallbackContext{ .stats = &fallbackStats, .trace = &fallbackTrace };
+	RunContext sequentialFallbackContext{ .stats = &sequentialFallbackStats, .trace = &sequentialFallbackTrace };
+	CHECK(traced_parallel.run(trailing, fallbackContext) == traced_parser.run(trailing, sequentialFallbackContext));
+	CHECK(fallbackStats.invocations == sequentialFallbackStats.invocations);
+	CHECK(fallbackTrace.events().size() == sequentialFallbackTrace.events().size());
+	parallelContext = RunContext{ .recognizing = true };
+	CHECK(parallel_parser.run(document, parallelContext) == ParserState{ document, document.length() });
+
+	// wrong element boundaries and errors take the sequential path
+	for (auto input : { document.substr(0, document.length() - 1), document + "]", "[" + document.substr(2),
+		"[1,2,3" + std::string(20, ',') + "]", std::string("[]") }) {
+		CHECK(parallel_parser.run(input) == array_parser.run(input));
+	}
+
+	// star over bracketed elements
+	auto group_parser = Parsers::star(Parsers::betweenBrackets(Parsers::sepBy_plus(Parsers::str(" "))(Parsers::letters())));
+	auto parallel_groups = Parsers::parallel(group_parser, options);
+	std::string groups;
+	for (int i = 0; i < 100; ++i) {
+		groups += i % 2 == 0 ? "(ab cd)" : "(ef)";
+	}
+	for (auto input : { groups, groups + "(gh", groups + "x", groups + "(1)" }) {
+		CHECK(parallel_groups.run(input) == group_parser.run(input));
+	}
+	CHECK(parallel_groups.run(groups).result.values.size() == 150);
+
+	// parsers which can't be split stay as they are
+	auto digits = Parsers::digits();
+	CHECK(Parsers::parallel(digits).transformerFn.target_type() == digits.transformerFn.target_type());
+}
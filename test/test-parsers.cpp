@@ -13,7 +13,7 @@ TEST_CASE("str parser") {
 	// fail
 	result = str_parser.run("test");
 	CHECK(result == ParserState{
-		 "test", 0, {}, true, "str: Tried to match \"Hello there!\", but got \"test\""
+		 "test", 0, {}, true, "Expected \"Hello there!\" at index 0"
 	});
 }
 
@@ -29,7 +29,7 @@ TEST_CASE("letters parser") {
 	// fail
 	result = letters_parser.run("123456");
 	CHECK(result == ParserState{
-		 "123456", 0, {}, true, "letters: Couldn't match letters at index 0"
+		 "123456", 0, {}, true, "Expected letters at index 0"
 	});
 }
 
@@ -45,7 +45,7 @@ TEST_CASE("digits parser") {
 	// fail
 	result = digits_parser.run("Hello");
 	CHECK(result == ParserState{
-		 "Hello", 0, {}, true, "digits: Couldn't match digits at index 0"
+		 "Hello", 0, {}, true, "Expected digits at index 0"
 	});
 }
 
@@ -62,7 +62,7 @@ TEST_CASE("regexp parser") {
 	// fail
 	result = phone_parser.run("Hello");
 	CHECK(result == ParserState{
-		 "Hello", 0, {}, true, "phone: Couldn't match phone at index 0"
+		 "Hello", 0, {}, true, "Expected phone at index 0"
 	});
 }
 
@@ -84,7 +84,7 @@ TEST_CASE("compile time choice parser") {
 	// fail
 	result = compile_choice_parser.run("---");
 	ParserState test{
-		 "---", 0, {}, true, "choice: Unable to match with any parser at index 0"
+		 "---", 0, {}, true, "Expected letters or digits at index 0"
 	};
 	CHECK(result == test);
 }
@@ -107,7 +107,7 @@ TEST_CASE("run time choice parser") {
 	// fail
 	result = runtime_choice_parser.run("---");
 	ParserState test{
-		 "---", 0, {}, true, "choice: Unable to match with any parser at index 0"
+		 "---", 0, {}, true, "Expected letters or digits at index 0"
 	};
 	CHECK(result == test);
 }
@@ -159,11 +159,11 @@ TEST_CASE("plus parser") {
 	// fail
 	result = plus_parser.run("");
 	CHECK(result == ParserState{
-		 "", 0, {}, true, "plus: Unable to match any input using parser at index 0"
+		 "", 0, {}, true, "Expected letters or digits at index 0"
 	});
 	result = plus_parser.run("---");
 	ParserState test{
-		 "---", 0, {}, true, "plus: Unable to match any input using parser at index 0"
+		 "---", 0, {}, true, "Expected letters or digits at index 0"
 	};
 	CHECK(result == test);
 }
@@ -181,7 +181,7 @@ TEST_CASE("between brackets parser") {
 	// fail
 	result = parser.run("(hello");
 	test = ParserState{
-		 "(hello", 6, {}, true, "str: Tried to match \")\", but got unexpected end of input."
+		 "(hello", 6, {}, true, "Expected \")\" at index 6"
 	};
 	CHECK(result == test);
 }
@@ -230,17 +230,17 @@ TEST_CASE("digits letters sequenceOf parser") {
 	result = seq_parser.run("12345hello");
 	//std::println("{}", result);
 	CHECK(result == ParserState{
-		 "12345hello", 10, {}, true, "digits: Got unexpected end of input."
+		 "12345hello", 10, {}, true, "Expected digits at index 10"
 		});
 	result = seq_parser.run("Hello there!test");
 	// fail
 	CHECK(result == ParserState{
-		 "Hello there!test", 0, {}, true, "digits: Couldn't match digits at index 0"
+		 "Hello there!test", 0, {}, true, "Expected digits at index 0"
 	}); 
 	// empty fail
 	result = seq_parser.run("");
 	CHECK(result == ParserState{
-		 "", 0, {}, true, "digits: Got unexpected end of input."
+		 "", 0, {}, true, "Expected digits at index 0"
 	});
 }
 
@@ -519,3 +519,117 @@ TEST_CASE("contextual coroutine") {
 	};
 	CHECK(result == test);
 }
+
+
+TEST_CASE("line and column positions") {
+	LineIndex lines("ab\ncd\n\nefgh ijkl mnop qrst uvwx\nyz");
+	CHECK(lines.position(0) == Position{ 1, 1 });
+	CHECK(lines.position(2) == Position{ 1, 3 });
+	CHECK(lines.position(3) == Position{ 2, 1 });
+	CHECK(lines.position(6) == Position{ 3, 1 });
+	CHECK(lines.position(12) == Position{ 4, 6 });
+	CHECK(lines.position(32) == Position{ 5, 1 });
+	CHECK(lines.position(33) == Position{ 5, 2 });
+
+	auto parser = Parsers::sepBy_plus(Parsers::str("\n"))(Parsers::digits())
+		.chain([](const ParseResult&) -> const Parser {
+			return Parsers::str(";");
+		})
+		.mapErrorPosition([](const std::string&, const Position& position) -> std::string {
+			return std::format("Expected ';' at line {}, column {}", position.line, position.column);
+		});
+	// success
+	RunContext context;
+	auto result = parser.run("1\n22\n333;", context);
+	CHECK(result == ParserState{
+		"1\n22\n333;", 9, { {";"} }
+	});
+	CHECK(context.lines.position(result.index) == Position{ 3, 5 });
+	// fail
+	result = parser.run("1\n22\n333");
+	CHECK(result == ParserState{
+		"1\n22\n333", 8, {}, true, "Expected ';' at line 3, column 4"
+	});
+}
+
+
+TEST_CASE("furthest failure") {
+	auto parser = Parsers::choice({
+		Parsers::sequenceOf({ Parsers::str("("), Parsers::choice(Parsers::letters(), Parsers::digits()) }),
+		Parsers::str("["),
+		Parsers::digits()
+	});
+	// the error of the run names what the furthest failure expected
+	RunContext context;
+	auto result = parser.run("(-", context);
+	CHECK(result == ParserState{
+		"(-", 0, {}, true, "Expected letters or digits at index 1"
+	});
+	CHECK(context.failure.message() == "Expected letters or digits at index 1");
+
+	context = RunContext{};
+	result = parser.run("-", context);
+	CHECK(context.failure.message() == "Expected \"(\", \"[\" or digits at index 0");
+
+	context = RunContext{};
+	result = parser.run("12", context);
+	CHECK(!result.isError);
+	CHECK(context.failure.message() == "Expected \"(\" or \"[\" at index 0");
+
+	// an item has one id in every thread
+	std::uint32_t threadId = 0;
+	std::thread([&]() { threadId = FurthestFailure::itemId("\"(\""); }).join();
+	CHECK(threadId == FurthestFailure::itemId("\"(\""));
+	CHECK(FurthestFailure::itemName(threadId) == "\"(\"");
+
+	// a parser called without a context formats its own message
+	CHECK(Parsers::str("a").transformerFn(ParserState{ "b" }).error == "str: Tried to match \"a\", but got \"b\"");
+}
+
+
+TEST_CASE("grammar optimizer") {
+	using Kind = GrammarNode::Kind;
+	// nested sequences are flattened, adjacent literals merged
+	auto seq_parser = Parsers::sequenceOf(
+		Parsers::sequenceOf(Parsers::str("a"), Parsers::str("b")),
+		Parsers::str("c"),
+		Parsers::digits()
+	);
+	REQUIRE(seq_parser.node != nullptr);
+	CHECK(seq_parser.node->kind == Kind::Sequence);
+	CHECK(seq_parser.node->children.size() == 2);
+	CHECK(seq_parser.node->children[0].node->kind == Kind::Literals);
+	CHECK(seq_parser.run("abc12") == ParserState{
+		"abc12", 5, { {"a", "b", "c", "12"} }
+	});
+	CHECK(seq_parser.run("abx12") == ParserState{
+		"abx12", 2, {}, true, "Expected \"c\" at index 2"
+	});
+	// nested choices are flattened
+	auto choice_parser = Parsers::choice({
+		Parsers::choice(Parsers::str("x"), Parsers::str("y")),
+		Parsers::digits()
+	});
+	CHECK(choice_parser.node->children.size() == 3);
+	CHECK(choice_parser.run("y") == ParserState{ "y", 1, { {"y"} } });
+	CHECK(choice_parser.run("-") == ParserState{
+		"-", 0, {}, true, "Expected \"x\", \"y\" or digits at index 0"
+	});
+	// star and plus over literals and characters scan in bulk
+	auto star_parser = Parsers::star(Parsers::str("ab"));
+	CHECK(star_parser.node->kind == Kind::RepeatLiteral);
+	CHECK(star_parser.run("ababa") == ParserState{ "ababa", 4, { {"ab", "ab"} } });
+	auto plus_parser = Parsers::plus(Parsers::choice(Parsers::str("0"), Parsers::str("1")));
+	CHECK(plus_parser.node->kind == Kind::RepeatBytes);
+	CHECK(plus_parser.run("0110201") == ParserState{ "0110201", 4, { {"0", "1", "1", "0"} } });
+	CHECK(plus_parser.run("2") == ParserState{
+		"2", 0, {}, true, "Expected \"0\" or \"1\" at index 0"
+	});
+	RunContext context;
+	plus_parser.run("01x", context);
+	CHECK(context.failure.message() == "Expected \"0\" or \"1\" at index 2");
+	// between doesn't slice the result of str brackets
+	auto between_parser = Parsers::betweenBrackets(Parsers::letters());
+	CHECK(between_parser.node->kind == Kind::Between);
+	CHECK(between_parser.run("(ab)") == ParserState{ "(ab)", 4, { {"ab"} } });
+}
@@ -0,0 +1,37 @@
+TEST_CASE("program files") {
+	// list <- "[" value ("," value)* "]", value <- number / word / list
+	Parser value;
+	auto valueRule = Parsers::lazy([&value]() { return value; });
+	const auto number = Parsers::regexp(std::string("[0-9]+"), "number", 1)
+		.map("double", [](const ParseResult& result) { return ParseResult{ { result.values[0] + result.values[0] } }; });
+	const auto word = Parsers::named("word", Parsers::letters().chain([](const ParseResult& result) {
+		return Parsers::succeed(ParseResult{ { "<" + result.values[0] + ">" } });
+	}));
+	const auto list = Parsers::between(Parsers::str("["), Parsers::str("]"))(
+		Parsers::sepBy_star(Parsers::str(","))(valueRule));
+	value = Parsers::choice(number, word, list, Parsers::optimize(Parsers::plus(Parsers::str("-"))));
+	const auto program = Program::compile(value);
+
+	std::stringstream image;
+	program.write(image);
+	const ProgramBindings bindings{
+		.parsers = { { "word", word } },
+		.maps = { { "double", [](const ParseResult& result) { return ParseResult{ { result.values[0] + result.values[0] } }; } } } };
+	const auto read = Program::read(image.str(), bindings);
+	CHECK(read.code().size() == program.code().size());
+	for (auto input : { "[1,ab,[--,2]]", "12", "[]", "---" }) {
+		CAPTURE(input);
+		CHECK(read.run(input) == program.run(input));
+	}
+	CHECK(read.run("[1,ab,[--,2]]") == ParserState{ "[1,ab,[--,2]]", 13, { { "11", "<ab>", "-", "-", "22" } } });
+	// errors come from the furthest failure
+	CHECK(read.run("[1,?]") == ParserState{ "[1,?]", 3, {}, true, "Expected number, letters, \"[\", \"-\" or \"]\" at index 3" });
+
+	// closures without a name or a binding
+	CHECK_THROWS_AS(Program::read(image.str()), std::runtime_error);
+	CHECK_THROWS_AS(Program::read("PCPROG01"), std::runtime_error);
+	CHECK_THROWS_AS(Program::read("not a program"), std::runtime_error);
+	std::stringstream unnamed;
+	CHECK_THROWS_AS(Program::compile(Parsers::str("a").map([](const ParseResult& result) { return result; })).write(unnamed), std::invalid_argument);
+	CHECK_THROWS_AS(Program::compile(Parsers::regexp(std::regex("a"))).write(unnamed), std::invalid_argument);
+}
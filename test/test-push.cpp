@@ -0,0 +1,59 @@
+TEST_CASE("push parser") {
+	// counts the parsed parts of the message
+	int commandCalls = 0;
+	int keyCalls = 0;
+	auto counter = [](int& calls) {
+		return [&calls](const ParseResult& result) {
+			++calls;
+			return result;
+		};
+	};
+	auto command_parser = Parsers::str("SET ").map(counter(commandCalls));
+	auto message_parser = Parsers::sequenceOf({
+		command_parser,
+		Parsers::letters().map(counter(keyCalls)),
+		Parsers::str("="),
+		Parsers::sepBy_plus(Parsers::str(","))(Parsers::digits()),
+		Parsers::str(";")
+	});
+
+	// one byte at a time, the message isn't parsed from the start again
+	PushParser parser(message_parser);
+	const std::string_view message = "SET key=1,22,333;";
+	for (std::size_t i = 0; i + 1 < message.length(); ++i) {
+		CHECK(parser.feed(message.substr(i, 1)) == ParseStatus::NeedMore);
+	}
+	CHECK(parser.feed(";") == ParseStatus::Complete);
+	CHECK(commandCalls == 1);
+	CHECK(keyCalls == 1);
+	CHECK(parser.state() == ParserState{
+		message, 17, { {"SET ", "key", "=", "1", "22", "333", ";"} }
+	});
+
+	// pipelined messages, the rest of the input starts the next one
+	CHECK(parser.reset() == ParseStatus::NeedMore);
+	CHECK(parser.feed("SET a=1;SET b") == ParseStatus::Complete);
+	CHECK(parser.state().result == ParseResult{ {"SET ", "a", "=", "1", ";"} });
+	CHECK(parser.rest() == "SET b");
+	CHECK(parser.feed("=2;") == ParseStatus::Complete);
+	CHECK(parser.rest() == "SET b=2;");
+	CHECK(parser.reset() == ParseStatus::Complete);
+	CHECK(parser.state().result == ParseResult{ {"SET ", "b", "=", "2", ";"} });
+	CHECK(parser.rest() == "");
+
+	// errors come as soon as the input can't match any more
+	CHECK(parser.reset() == ParseStatus::NeedMore);
+	CHECK(parser.feed("SET a=1,") == ParseStatus::NeedMore);
+	CHECK(parser.feed("x") == ParseStatus::Error);
+	CHECK(parser.state().error == "Expected digits or \";\" at index 8");
+
+	// the end of input decides a message ending with a regexp
+	auto number_parser = PushParser(Parsers::digits());
+	CHECK(number_parser.feed("12") == ParseStatus::NeedMore);
+	CHECK(number_parser.feed("3") == ParseStatus::NeedMore);
+	CHECK(number_parser.finish() == ParseStatus::Complete);
+	CHECK(number_parser.state().result == ParseResult{ {"123"} });
+	CHECK(number_parser.reset() == ParseStatus::NeedMore);
+	CHECK(number_parser.finish() == ParseStatus::Error);
+	CHECK(number_parser.state().error == "Expected digits at index 0");
+}
@@ -0,0 +1,92 @@
+TEST_CASE("sink events") {
+	const auto number = FurthestFailure::itemId("digits");
+	const auto record = FurthestFailure::itemId("record");
+	auto record_parser = Parsers::traced("record", Parsers::sepBy_plus(Parsers::str(","))(
+		// map would throw on the empty results of sink mode, it isn't called there
+		Parsers::digits().map([](const ParseResult& result) { return ParseResult{ { result.values.at(0) } }; })));
+	auto file_parser = Parsers::sepBy_star(Parsers::str("\n"))(record_parser);
+
+	const std::string input = "1,2,3\n40,5\n6";
+	std::size_t records = 0;
+	std::size_t sum = 0;
+	std::size_t maxPending = 0;
+	ParseSink sink{ [&](const SinkEvent& event) {
+		if (event.kind == SinkEvent::Kind::Exit && event.itemId == record) {
+			CHECK(event.success);
+			++records;
+		}
+		if (event.kind == SinkEvent::Kind::Token && event.itemId == number) {
+			sum += std::stoul(input.substr(event.begin, event.end - event.begin));
+		}
+		maxPending = std::max(maxPending, sink.pending.size());
+	} };
+	RunContext context{ .sink = &sink };
+	auto result = file_parser.run(input, context);
+	CHECK(!result.isError);
+	CHECK(result.index == input.length());
+	CHECK(result.result.values.empty());
+	CHECK(records == 3);
+	CHECK(sum == 57);
+	CHECK(sink.pending.empty());
+	CHECK(sink.speculation == 0);
+	// events wait for the record they belong to, not for the whole input
+	CHECK(maxPending <= 8);
+
+	// failed alternatives give no events, the machine gives the same ones
+	auto choice_parser = Parsers::plus(Parsers::choice(
+		Parsers::sequenceOf(Parsers::str("a"), Parsers::str("b")),
+		Parsers::str("a"),
+		Parsers::regexp(std::regex("[cd]"), "cd")
+	));
+	std::vector<SinkEvent> events;
+	ParseSink recorder{ [&events](const SinkEvent& event) { events.push_back(event); } };
+	context = RunContext{ .sink = &recorder };
+	CHECK(choice_parser.run("aabcx", context).index == 4);
+	const auto a = FurthestFailure::itemId("\"a\"");
+	const auto b = FurthestFailure::itemId("\"b\"");
+	const auto cd = FurthestFailure::itemId("cd");
+	using Kind = SinkEvent::Kind;
+	const std::vector<SinkEvent> expected{
+		{ Kind::Token, a, 0, 1 }, { Kind::Token, a, 1, 2 }, { Kind::Token, b, 2, 3 }, { Kind::Token, cd, 3, 4 } };
+	CHECK(events == expected);
+
+	events.clear();
+	context = RunContext{ .sink = &recorder };
+	CHECK(Program::compile(choice_parser).run("aabcx", context).index == 4);
+	CHECK(events == expected);
+	CHECK(recorder.speculation == 0);
+
+	// a root choice doesn't hold the events of an alternative which can't fail
+	std::string pairs;
+	for (int i = 0; i < 100000; ++i) {
+		pairs += "ab";
+	}
+	std::size_t tokens = 0;
+	maxPending = 0;
+	ParseSink counter{ [&](const SinkEvent&) {
+		++tokens;
+		maxPending = std::max(maxPending, counter.pending.size());
+	} };
+	context = RunContext{ .sink = &counter };
+	CHECK(Parsers::choice({ Parsers::star(Parsers::str("ab")), Parsers::str("x") }).run(pairs, context).index == pairs.length());
+	CHECK(tokens == 100000);
+	CHECK(maxPending == 0);
+	// nor the iterations of a loop over a parser which fails without events
+	tokens = 0;
+	context = RunContext{ .sink = &counter };
+	CHECK(Parsers::plus(Parsers::str("ab")).run(pairs, context).index == pairs.length());
+	CHECK(tokens == 100000);
+	CHECK(maxPending == 0);
+
+	// chain callbacks get the values of their parser
+	std::vector<std::string> sizes;
+	auto sized_parser = Parsers::digits().chain([&sizes](const ParseResult& result) {
+		sizes.push_back(result.values.at(0));
+		return Parsers::str(std::string(std::stoul(result.values.at(0)), '.'));
+	});
+	events.clear();
+	context = RunContext{ .sink = &recorder };
+	CHECK(sized_parser.run("3...", context).index == 4);
+	CHECK(sizes == std::vector<std::string>{ "3" });
+	CHECK(events == std::vector<SinkEvent>{ { Kind::Token, FurthestFailure::itemId("\"...\""), 1, 4 } });
+}
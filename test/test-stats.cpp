@@ -0,0 +1,66 @@
+TEST_CASE("run statistics") {
+	auto brackets_parser = Parsers::between(
+		Parsers::str("["), Parsers::str("]"));
+	auto comma_parser = Parsers::sepBy_star(Parsers::str(","));
+
+	Parser array_parser;
+	auto value_parser = Parsers::lazy([&array_parser]() {
+		return Parsers::choice(
+			Parsers::str("x"),
+			Parsers::digits(),
+			array_parser
+		);
+	});
+	array_parser = brackets_parser(comma_parser(value_parser));
+
+	// nothing is counted without stats
+	const auto before = RunStats::total();
+	array_parser.run("[1,[2]]");
+	CHECK(RunStats::total() == before);
+
+	RunStats stats;
+	RunContext context{ .stats = &stats };
+	auto result = array_parser.run("[1,[2]]", context);
+	CHECK(!result.isError);
+	CHECK(stats.runs == 1);
+	CHECK(stats.invocations == 16);
+	// "x" before each number, "x" and digits before the inner list
+	CHECK(stats.backtracks == 4);
+	CHECK(stats.maxDepth == 2);
+	CHECK(stats.consumed == 7);
+	CHECK(stats.examined == 7);
+	// the failed alternatives and separators
+	CHECK(stats.errors == 6);
+#ifdef COMBINATORS_COUNT_ALLOCATIONS
+	CHECK(stats.allocations > 0);
+	CHECK(stats.allocatedBytes > 0);
+#else
+	CHECK(stats.allocations == 0);
+#endif
+
+	// runs with the same stats add up, the process total gets every run
+	const auto once = stats;
+	array_parser.run("[1,[2]]", context = RunContext{ .stats = &stats });
+	CHECK(stats.runs == 2);
+	CHECK(stats.invocations == 2 * once.invocations);
+	CHECK(stats.maxDepth == 2);
+	const auto total = RunStats::total();
+	CHECK(total.runs >= before.runs + 2);
+	CHECK(total.invocations >= before.invocations + stats.invocations);
+
+	// compiled programs count machine literals and backtracks (loop exits too), without error messages on success
+	RunStats programStats;
+	const auto program = Program::compile(array_parser);
+	result = program.run("[1,[2]]", context = RunContext{ .stats = &programStats });
+	CHECK(!result.isError);
+	CHECK(programStats.runs == 1);
+	CHECK(programStats.backtracks == 6);
+	CHECK(programStats.consumed == 7);
+	CHECK(programStats.errors < stats.errors / 2);
+	CHECK(programStats.examined == 7);
+
+	// metrics for scrapers
+	const auto text = RunStats::exportTotal();
+	CHECK(text.contains("# TYPE combinators_runs_total counter\n"));
+	CHECK(text.contains(std::format("\ncombinators_invocations_total {}\n", RunStats::total().invocations)));
+}
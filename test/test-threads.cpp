@@ -0,0 +1,75 @@
+TEST_CASE("shared grammar across threads") {
+	// built once, run from every thread
+	auto brackets_parser = Parsers::between(
+		Parsers::str("["), Parsers::str("]"));
+	auto comma_parser = Parsers::sepBy_star(Parsers::str(","));
+
+	Parser array_parser;
+	auto value_parser = Parsers::memo(Parsers::lazy([&array_parser]() {
+		return Parsers::choice(
+			Parsers::digits().map([](const ParseResult& result) -> ParseResult {
+				return { { std::format("#{}", result.values[0]) } };
+			}),
+			array_parser
+		);
+	}));
+	array_parser = brackets_parser(comma_parser(value_parser));
+	const auto program = Program::compile(array_parser);
+
+	auto declaration_parser = Parsers::contextual([]() -> Generator<ParseResult, Parser> {
+		const ParseResult name = co_yield Parsers::letters();
+		co_yield Parsers::str("=");
+		const ParseResult value = co_yield Parsers::digits();
+		ParseResult result = name;
+		result += value;
+		co_return result;
+	});
+
+	Lexer lexer;
+	const auto number = lexer.regexp(std::regex("\\d+"), "number");
+	const auto plus = lexer.str("+");
+	lexer.skip(std::regex("\\s+"));
+	auto sum_parser = Parsers::sepBy_plus(lexer.token(plus))(lexer.token(number));
+
+	std::vector<std::string> arrays;
+	std::vector<std::string> declarations;
+	std::vector<std::string> sums;
+	for (int i = 0; i < 16; ++i) {
+		arrays.push_back(std::format("[{},[{},[{}]],{}]", i, i + 1, i + 2, i % 3 == 0 ? "x" : "3"));
+		declarations.push_back(std::format("{}={}", std::string(i % 5 + 1, 'a'), i));
+		sums.push_back(std::format("{} + {} + {}", i, i * 2, i * 3));
+	}
+	auto runAll = [&](std::size_t i) {
+		const auto& text = arrays[i % arrays.size()];
+		MemoTable memo;
+		RunContext context{ .memo = &memo };
+		const auto tokens = lexer.tokenize(sums[i % sums.size()]);
+		return std::make_tuple(
+			array_parser.run(text, context),
+			program.run(text),
+			declaration_parser.run(declarations[i % declarations.size()]),
+			sum_parser.run(tokens).result
+		);
+	};
+	std::vector<decltype(runAll(0))> expected;
+	for (std::size_t i = 0; i < arrays.size(); ++i) {
+		expected.push_back(runAll(i));
+	}
+	CHECK(std::get<0>(expected[1]).result == ParseResult{ {"#1", "#2", "#3", "#3"} });
+	CHECK(std::get<3>(expected[1]) == ParseResult{ {"1", "2", "3"} });
+
+	std::atomic<int> mismatches = 0;
+	{
+		std::vector<std::jthread> threads;
+		for (std::size_t thread = 0; thread < 64; ++thread) {
+			threads.emplace_back([&, thread]() {
+				for (std::size_t i = thread; i < thread + 200; ++i) {
+					if (runAll(i) != expected[i % expected.size()]) {
+						++mismatches;
+					}
+				}
+			});
+		}
+	}
+	CHECK(mismatches == 0);
+}
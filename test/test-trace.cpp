@@ -0,0 +1,91 @@
+TEST_CASE("trace recording") {
+	auto brackets_parser = Parsers::between(
+		Parsers::str("["), Parsers::str("]"));
+	auto comma_parser = Parsers::sepBy_star(Parsers::str(","));
+
+	Parser array_parser;
+	auto number_parser = Parsers::traced("number", Parsers::digits());
+	auto value_parser = Parsers::lazy([&]() {
+		return Parsers::choice(
+			number_parser,
+			array_parser
+		);
+	});
+	array_parser = Parsers::traced("array", brackets_parser(comma_parser(value_parser)));
+
+	// nothing is recorded without a trace buffer
+	CHECK(array_parser.run("[1,[2]]") == ParserState{ "[1,[2]]", 7, { {"1", "2"} } });
+
+	TraceBuffer trace;
+	RunContext context{ .trace = &trace };
+	CHECK(array_parser.run("[1,[2]]", context) == ParserState{ "[1,[2]]", 7, { {"1", "2"} } });
+	// calls end before their parents
+	auto events = trace.events();
+	REQUIRE(events.size() == 5);
+	const auto number = FurthestFailure::itemId("number");
+	const auto array = FurthestFailure::itemId("array");
+	auto call = [](const TraceEvent& event) {
+		return std::make_tuple(event.ruleId, event.success, event.offset);
+	};
+	CHECK(call(events[0]) == std::make_tuple(number, true, 1u));
+	CHECK(call(events[1]) == std::make_tuple(number, false, 3u));
+	CHECK(call(events[2]) == std::make_tuple(number, true, 4u));
+	CHECK(call(events[3]) == std::make_tuple(array, true, 3u));
+	CHECK(call(events[4]) == std::make_tuple(array, true, 0u));
+	CHECK(events[4].start <= events[0].start);
+	CHECK(events[4].duration >= events[3].duration);
+	CHECK(trace.dropped() == 0);
+
+	// binary log round trip, the rule names come with it
+	std::stringstream log;
+	trace.write(log);
+	const auto read = TraceLog::read(log);
+	CHECK(read.events == events);
+	CHECK(read.names.at(number) == "number");
+	CHECK(read.names.at(array) == "array");
+	std::stringstream notLog("not a trace");
+	CHECK_THROWS_AS(TraceLog::read(notLog), std::runtime_error);
+	// lengths and counts past the end of the log, after the magic, dropped count and the first name id
+	auto damaged = [&log](std::size_t offset, std::size_t bytes) {
+		auto text = log.str();
+		text.replace(offset, bytes, std::string(bytes, '\xff'));
+		std::stringstream in(text);
+		CHECK_THROWS_AS(TraceLog::read(in), std::runtime_error);
+	};
+	damaged(24, 4);
+	damaged(log.str().length() - events.size() * 29 - 8, 8);
+	std::stringstream truncated(log.str().substr(0, log.str().length() - 1));
+	CHECK_THROWS_AS(TraceLog::read(truncated), std::runtime_error);
+
+	const auto json = read.toChromeJson();
+	CHECK(json.starts_with("{\"traceEvents\":["));
+	CHECK(json.contains("\"name\":\"array\",\"cat\":\"rule\",\"ph\":\"X\""));
+	CHECK(json.contains("\"args\":{\"offset\":3,\"success\":false}"));
+
+	const auto summary = read.summary();
+	REQUIRE(summary.size() == 2);
+	for (auto& rule : summary) {
+		CHECK(rule.self <= rule.total);
+		if (rule.name == "number") {
+			CHECK(rule.calls == 3);
+			CHECK(rule.failures == 1);
+			// no nested traced rules
+			CHECK(rule.self == rule.total);
+		}
+		else {
+			CHECK(rule.calls == 2);
+			CHECK(rule.failures == 0);
+		}
+	}
+	CHECK(read.summaryText().contains("number"));
+
+	// the ring keeps the latest events
+	TraceBuffer small(2);
+	array_parser.run("[1,[2]]", context = RunContext{ .trace = &small });
+	REQUIRE(small.events().size() == 2);
+	CHECK(call(small.events()[0]) == std::make_tuple(array, true, 3u));
+	CHECK(call(small.events()[1]) == std::make_tuple(array, true, 0u));
+	CHECK(small.dropped() == 3);
+
+	CHECK(anonymizeInput("{\"Name\": \"x1\", \"id\": 42}") == "{\"Aaaa\": \"a0\", \"aa\": 00}");
+}
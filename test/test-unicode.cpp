@@ -0,0 +1,44 @@
+TEST_CASE("utf8 character classes") {
+	const std::string ascii(40, 'a');
+	CHECK(validateUtf8("") == 0);
+	CHECK(validateUtf8(ascii + "\xD0\x9F\xE2\x82\xAC\xF0\x9F\x98\x80" + ascii) == 89);
+	// overlong, surrogate, past U+10FFFF, cut sequence, stray continuation byte
+	CHECK(validateUtf8(ascii + "\xC0\x80") == 40);
+	CHECK(validateUtf8("ab\xED\xA0\x80") == 2);
+	CHECK(validateUtf8("\xF4\x90\x80\x80") == 0);
+	CHECK(validateUtf8(ascii + "\xE2\x82") == 40);
+	CHECK(validateUtf8("a\x80") == 1);
+
+	// Привет, мир
+	const std::string russian = "\xD0\x9F\xD1\x80\xD0\xB8\xD0\xB2\xD0\xB5\xD1\x82, \xD0\xBC\xD0\xB8\xD1\x80";
+	auto result = Parsers::utf8Letters().run(russian);
+	CHECK(!result.isError);
+	CHECK(result.index == 12);
+	CHECK(result.result.values == std::vector<std::string>{ russian.substr(0, 12) });
+
+	// ASCII runs longer than a step, then naïve and digits
+	const std::string word = ascii + "na\xC3\xAFve" + "123" + ascii;
+	CHECK(Parsers::utf8Letters().run(word).index == 46);
+	CHECK(Parsers::utf8Alnum().run(word).index == word.length());
+	CHECK(Parsers::utf8Alnum().run("\xD9\xA3\xD9\xA4!").index == 4);
+
+	// tab, no-break space, ideographic space
+	auto spaces = Parsers::utf8Whitespace().run("\t \xC2\xA0\xE3\x80\x80x");
+	CHECK(spaces.index == 7);
+	auto fail = Parsers::utf8Whitespace().run("x");
+	CHECK(fail.isError);
+	CHECK(fail.error == "Expected whitespace at index 0");
+
+	auto words = Parsers::sepBy_plus(Parsers::utf8Whitespace())(Parsers::utf8Letters());
+	RunContext context{ .utf8 = true };
+	result = words.run("\xD0\xBC\xD0\xB8\xD1\x80 caf\xC3\xA9", context);
+	CHECK(result.result.values.size() == 2);
+	CHECK(result.index == 12);
+	// invalid input fails before parsing
+	context = RunContext{ .utf8 = true };
+	result = words.run("caf\xC3", context);
+	CHECK(result.isError);
+	CHECK(result.error == "utf8: Invalid UTF-8 at index 3");
+	context = RunContext{ .utf8 = true };
+	CHECK(Program::compile(words).run("caf\xC3", context).error == "utf8: Invalid UTF-8 at index 3");
+}
@@ -2,6 +2,45 @@
 
 #include <doctest/doctest.h>
 
+#include <sstream>
+#include <thread>
+
 #include "../ParserCombinators.h"
+#include "../Lexer.h"
+#include "../Incremental.h"
+#include "../Bytecode.h"
+#include "../AsyncIO.h"
+#include "../PushParser.h"
+#include "../Trace.h"
+#include "../Grammars.h"
+#include "../Adversarial.h"
+#include "../Analysis.h"
+#include "../Adaptive.h"
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
 
 #include "test-parsers.cpp"
+#include "test-lexer.cpp"
+#include "test-incremental.cpp"
+#include "test-bytecode.cpp"
+#include "test-async.cpp"
+#include "test-push.cpp"
+#include "test-parallel.cpp"
+#include "test-threads.cpp"
+#include "test-stats.cpp"
+#include "test-trace.cpp"
+#include "test-ast.cpp"
+#include "test-sink.cpp"
+#include "test-unicode.cpp"
+#include "test-grammars.cpp"
+#include "test-adversarial.cpp"
+#include "test-analysis.cpp"
+#include "test-limits.cpp"
+#include "test-binary.cpp"
+#include "test-program-file.cpp"
+#include "test-adaptive.cpp"
+#include "test-lookahead.cpp"